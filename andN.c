@@ -24,6 +24,10 @@
 
 #define MAX_NUM_INPUTS 128
 
+// Inputs are packed into 64 bit words so the and/or is a handful of word
+// operations with a fixed cost regardless of the input values.
+#define WORD_BITS 64
+
 MODULE_AUTHOR("John Allwine");
 MODULE_DESCRIPTION("And up to 128 inputs together.");
 MODULE_LICENSE("GPL");
@@ -31,6 +35,8 @@ MODULE_LICENSE("GPL");
 typedef struct {
   hal_bit_t **inputs;
   hal_bit_t *output;
+  hal_s32_t *activeCount;  // number of inputs that are high
+  hal_s32_t *firstLow;    // index of the first low input, -1 if there isn't one
   int numInputs;
 } data_t;
 
@@ -46,15 +52,31 @@ RTAPI_IP_INT(defaultValue, "default state of inputs, 0 or 1.");
 static int update(void *arg, const hal_funct_args_t *fa) {
   data_t *data = (data_t*)arg;
 
-  int out = 1;
-  for(int i = 0; i < data->numInputs; i++) {
-    if(!*(data->inputs[i])) {
-      out = 0;
-      break;
+  int count = 0;
+  int first = -1;
+  for(int base = 0; base < data->numInputs; base += WORD_BITS) {
+    const int n = data->numInputs-base < WORD_BITS ? data->numInputs-base : WORD_BITS;
+    const uint64_t mask = n == WORD_BITS ? ~(uint64_t)0 : (((uint64_t)1 << n)-1);
+
+    uint64_t word = 0;
+    for(int i = 0; i < n; i++) {
+      word |= (uint64_t)(*(data->inputs[base+i]) != 0) << i;
+    }
+
+    count += __builtin_popcountll(word);
+    if(first < 0) {
+      // bits of inputs that are low
+      const uint64_t found = ~word & mask;
+      if(found) {
+        first = base+__builtin_ctzll(found);
+      }
     }
   }
 
-  *(data->output) = out;
+  *(data->activeCount) = count;
+  *(data->firstLow) = first;
+  *(data->output) = first < 0;
+  return 0;
 };
 
 static int instantiate_instance(const int argc, char* const *argv) {
@@ -94,11 +116,26 @@ static int instantiate_instance(const int argc, char* const *argv) {
     return r;
   }
 
+  r = hal_pin_s32_newf(HAL_OUT, &(data->activeCount), inst_id, "%s.active-count", instname);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.active-count'\n", modname, instname);
+    return r;
+  }
+
+  r = hal_pin_s32_newf(HAL_OUT, &(data->firstLow), inst_id, "%s.first-low", instname);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.first-low'\n", modname, instname);
+    return r;
+  }
+
+  *(data->activeCount) = 0;
+  *(data->firstLow) = -1;
+
   hal_export_xfunct_args_t updateArgs = {
     .type = FS_XTHREADFUNC,
     .funct.x = update,
     .arg = data,
-    .uses_fp = 1,
+    .uses_fp = 0,
     .reentrant = 0,
     .owner_id = inst_id
   };
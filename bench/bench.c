@@ -0,0 +1,255 @@
+/********************************************************************
+* Description:  bench.c
+*               Microbenchmark for the update functions of a HAL
+*               component. It's linked with one component and the
+*               userspace HAL stand-in in halstub/, loads the
+*               component, then calls each of its functs for a number
+*               of cycles while driving the input pins with a fixed
+*               pseudo random sequence. The cost of driving the pins
+*               is measured separately and subtracted. Where the kernel
+*               allows it, the instructions retired are also counted
+*               with perf_event_open.
+*
+*               Usage: bench [-n cycles] [-p period] [name=value ...] [-- args]
+*
+*               name=value sets a module or instance parameter. If the
+*               component is instantiable, an instance named after the
+*               component is created with any args after --.
+*
+*               Prints one line per funct:
+*               <funct> <ns/cycle> <instructions/cycle>
+*               with - for instructions/cycle if they can't be counted.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#include "halstub.h"
+#include "rtapi_app.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define DEFAULT_CYCLES 1000000
+#define DEFAULT_PERIOD 1000000
+
+// Each funct is timed this many times and the median run is reported, so
+// neither interruptions by the OS nor one unusually fast run move it much.
+#define RUNS 9
+
+// Inputs are driven from a table of pseudo random values so generating
+// them costs the same on every cycle.
+#define NUM_VALUES 4096
+
+typedef struct {
+  void *ptr;
+  hal_type_t type;
+} input_t;
+
+typedef struct {
+  long long ns;
+  long long instructions; // -1 if they can't be counted
+} measurement_t;
+
+static input_t *inputs;
+static int numInputs;
+static uint64_t values[NUM_VALUES];
+static int instructionCounter = -1;
+
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void find_inputs(void) {
+  const int numPins = halstub_num_pins();
+  inputs = calloc(numPins, sizeof(input_t));
+  for(int i = 0; i < numPins; i++) {
+    if(halstub_pin_dir(i) == HAL_IN) {
+      inputs[numInputs].ptr = halstub_pin_ptr(i);
+      inputs[numInputs].type = halstub_pin_type(i);
+      numInputs++;
+    }
+  }
+
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  for(int i = 0; i < NUM_VALUES; i++) {
+    values[i] = next_random(&state);
+  }
+}
+
+// Changes one input per cycle. Bits go high about one time in 256 and
+// floats stay within +-100, so state machines spend most of their time in
+// their normal states rather than faulting every cycle.
+static inline void drive_input(long cycle) {
+  if(numInputs == 0) {
+    return;
+  }
+  const input_t *input = &inputs[cycle % numInputs];
+  const uint64_t value = values[cycle % NUM_VALUES];
+  switch(input->type) {
+    case HAL_BIT:
+      *(hal_bit_t*)input->ptr = (value & 0xff) == 0;
+      break;
+    case HAL_FLOAT:
+      *(hal_float_t*)input->ptr = (double)(int64_t)value*(100.0/INT64_MAX);
+      break;
+    case HAL_S32:
+      *(hal_s32_t*)input->ptr = (int32_t)(value & 0xff);
+      break;
+    case HAL_U32:
+      *(hal_u32_t*)input->ptr = (uint32_t)(value & 0xff);
+      break;
+    case HAL_S64:
+      *(hal_s64_t*)input->ptr = (int64_t)(value & 0xff);
+      break;
+    case HAL_U64:
+      *(hal_u64_t*)input->ptr = value & 0xff;
+      break;
+  }
+}
+
+static long long now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec*1000000000LL+t.tv_nsec;
+}
+
+// Counts user space instructions retired by this thread. Leaves
+// instructionCounter at -1 if the kernel doesn't allow it, such as in a VM
+// without hardware counters or with perf_event_paranoid set too high.
+static void open_instruction_counter(void) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  instructionCounter = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long read_instructions(void) {
+  long long count = 0;
+  if(instructionCounter < 0 || read(instructionCounter, &count, sizeof(count)) != sizeof(count)) {
+    return -1;
+  }
+  return count;
+}
+
+static long long median(long long *values, int count) {
+  for(int i = 1; i < count; i++) {
+    const long long value = values[i];
+    int j = i;
+    for(; j > 0 && values[j-1] > value; j--) {
+      values[j] = values[j-1];
+    }
+    values[j] = value;
+  }
+  return values[count/2];
+}
+
+// Returns the median time of RUNS runs of cycles cycles, and the fewest
+// instructions, which only vary with interruptions. A negative funct only
+// drives the inputs.
+static measurement_t measure_cycles(int funct, long cycles, long period) {
+  measurement_t result = { .ns = -1, .instructions = -1 };
+  long long elapsedRuns[RUNS];
+  for(int run = 0; run < RUNS; run++) {
+    const long long startInstructions = read_instructions();
+    const long long start = now_ns();
+    for(long cycle = 0; cycle < cycles; cycle++) {
+      drive_input(cycle);
+      if(funct >= 0) {
+        halstub_run(funct, period);
+      }
+    }
+    elapsedRuns[run] = now_ns()-start;
+    const long long endInstructions = read_instructions();
+    if(startInstructions >= 0 && endInstructions >= 0) {
+      const long long instructions = endInstructions-startInstructions;
+      if(result.instructions < 0 || instructions < result.instructions) {
+        result.instructions = instructions;
+      }
+    }
+  }
+  result.ns = median(elapsedRuns, RUNS);
+  return result;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-n cycles] [-p period] [name=value ...] [-- args]\n", name);
+}
+
+int main(int argc, char **argv) {
+  long cycles = DEFAULT_CYCLES;
+  long period = DEFAULT_PERIOD;
+  int instArgc = 0;
+  char **instArgv = NULL;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-n") == 0 && i+1 < argc) {
+      cycles = strtol(argv[++i], NULL, 0);
+    } else if(strcmp(argv[i], "-p") == 0 && i+1 < argc) {
+      period = strtol(argv[++i], NULL, 0);
+    } else if(strcmp(argv[i], "--") == 0) {
+      instArgc = argc-i-1;
+      instArgv = argv+i+1;
+      break;
+    } else if(strchr(argv[i], '=')) {
+      if(halstub_set_param(argv[i]) < 0) {
+        fprintf(stderr, "%s: unknown parameter '%s'\n", argv[0], argv[i]);
+        return 1;
+      }
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if(cycles <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if(rtapi_app_main() < 0) {
+    fprintf(stderr, "%s: rtapi_app_main failed\n", argv[0]);
+    return 1;
+  }
+  if(halstub_instantiable() && halstub_newinst(halstub_component_name(), instArgc, instArgv) < 0) {
+    fprintf(stderr, "%s: could not create instance\n", argv[0]);
+    return 1;
+  }
+
+  find_inputs();
+
+  // messages would be timed along with the functs
+  halstub_set_msg_level(RTAPI_MSG_NONE);
+
+  open_instruction_counter();
+
+  const measurement_t overhead = measure_cycles(-1, cycles, period);
+  for(int funct = 0; funct < halstub_num_functs(); funct++) {
+    const measurement_t m = measure_cycles(funct, cycles, period);
+    const long long ns = m.ns-overhead.ns;
+    printf("%s %.2f", halstub_funct_name(funct), (double)(ns > 0 ? ns : 0)/cycles);
+    if(m.instructions >= 0 && overhead.instructions >= 0) {
+      const long long instructions = m.instructions-overhead.instructions;
+      printf(" %.1f\n", (double)(instructions > 0 ? instructions : 0)/cycles);
+    } else {
+      printf(" -\n");
+    }
+  }
+
+  rtapi_app_exit();
+  return 0;
+}
@@ -0,0 +1,62 @@
+#!/bin/sh
+# Compares benchmark results against a baseline and fails if any funct got
+# slower. Both files have lines of
+# <funct> <median ns/cycle> <spread ns/cycle> <instructions/cycle>, as
+# printed by summarize.sh.
+#
+# Instructions retired are nearly the same from run to run, so when both
+# files have them they're the gate, with instruction tolerance percent. Time
+# is then only reported. Instructions can't be counted on every machine, such
+# as in a VM without hardware counters. Without them, the median time fails
+# if it's more than ns tolerance percent plus the baseline's spread, as a
+# percentage of its median, slower. The two together are capped at max ns
+# tolerance percent.
+#
+# Usage: check.sh <baseline> <results> <instruction tolerance> <ns tolerance> <max ns tolerance>
+
+baseline=$1
+results=$2
+instructionTolerance=$3
+nsTolerance=$4
+maxNsTolerance=$5
+
+if [ ! -f "$baseline" ]; then
+  echo "No baseline $baseline, create one with make bench-baseline" >&2
+  exit 1
+fi
+
+awk -v instructionTolerance="$instructionTolerance" -v nsTolerance="$nsTolerance" -v maxNsTolerance="$maxNsTolerance" '
+  NR == FNR {
+    ns[$1] = $2
+    spread[$1] = $3
+    instructions[$1] = $4
+    next
+  }
+  {
+    if(!($1 in ns)) {
+      printf "%-28s %10.2f %10s %10s %10s   no baseline\n", $1, $2, "-", $4, "-"
+      next
+    }
+    if($4 != "-" && instructions[$1] != "-") {
+      status = "ok"
+      if($4 > instructions[$1]*(1+instructionTolerance/100)) {
+        status = "FAIL instructions/cycle"
+        failed = 1
+      }
+    } else {
+      status = "ok, ns only"
+      tolerance = nsTolerance + (ns[$1] > 0 ? 100*spread[$1]/ns[$1] : 0)
+      if(tolerance > maxNsTolerance) {
+        tolerance = maxNsTolerance
+      }
+      if($2 > ns[$1]*(1+tolerance/100)) {
+        status = "FAIL ns/cycle"
+        failed = 1
+      }
+    }
+    printf "%-28s %10.2f %10.2f %10s %10s   %s\n", $1, $2, ns[$1], $4, instructions[$1], status
+  }
+  END {
+    exit failed
+  }
+' "$baseline" "$results"
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Runs the same benchmark built with generic and tuned flags and prints
+# the ns/cycle of each funct side by side.
+#
+# Usage: compare.sh <generic bench> <tuned bench> [bench args ...]
+
+generic=$1
+tuned=$2
+shift 2
+
+genericOut=$(mktemp)
+tunedOut=$(mktemp)
+trap 'rm -f "$genericOut" "$tunedOut"' EXIT
+
+"$generic" "$@" | sort > "$genericOut" || exit 1
+"$tuned" "$@" | sort > "$tunedOut" || exit 1
+
+# each line is <funct> <generic ns> <generic instructions> <tuned ns> <tuned instructions>
+join "$genericOut" "$tunedOut" | awk '{
+  gain = $2 > 0 ? 100*($2-$4)/$2 : 0
+  printf "%-28s %10.2f %10.2f %7.1f%%\n", $1, $2, $4, gain
+}'
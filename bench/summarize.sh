@@ -0,0 +1,54 @@
+#!/bin/sh
+# Summarizes several runs of the benchmarks, as printed by bench, into one
+# line per funct:
+# <funct> <median ns/cycle> <spread ns/cycle> <median instructions/cycle>
+# The spread is the difference between the slowest and fastest run.
+# Instructions are - if any run couldn't count them.
+#
+# Usage: summarize.sh <results of several runs>
+
+awk '
+  function median(values, count,    i, j, t) {
+    for(i = 2; i <= count; i++) {
+      t = values[i]
+      for(j = i; j > 1 && values[j-1] > t; j--) {
+        values[j] = values[j-1]
+      }
+      values[j] = t
+    }
+    return count % 2 ? values[(count+1)/2] : (values[count/2]+values[count/2+1])/2
+  }
+  {
+    if(!($1 in runs)) {
+      order[++numFuncts] = $1
+      hasInstructions[$1] = 1
+    }
+    n = ++runs[$1]
+    ns[$1, n] = $2
+    instructions[$1, n] = $3
+    if($3 == "-") {
+      hasInstructions[$1] = 0
+    }
+  }
+  END {
+    for(f = 1; f <= numFuncts; f++) {
+      name = order[f]
+      count = runs[name]
+      min = max = ns[name, 1]
+      for(i = 1; i <= count; i++) {
+        values[i] = ns[name, i]
+        if(values[i] < min) min = values[i]
+        if(values[i] > max) max = values[i]
+      }
+      printf "%s %.2f %.2f", name, median(values, count), max-min
+      if(hasInstructions[name]) {
+        for(i = 1; i <= count; i++) {
+          values[i] = instructions[name, i]
+        }
+        printf " %.1f\n", median(values, count)
+      } else {
+        printf " -\n"
+      }
+    }
+  }
+' "$@"
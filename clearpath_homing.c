@@ -2,7 +2,9 @@
 * Description:  clearpath_homing
 *               This file, 'clearpath_homing.c', is a HAL component that 
 *               performs the hard stop or specific angle homing routines
-*               for Teknic's ClearPath SDSK servo motors.
+*               for Teknic's ClearPath SDSK servo motors. The
+*               position where each hard stop home stalls is captured
+*               and kept in a history to report home repeatability.
 *
 * Author: John Allwine <john@pocketnc.com>
 * License: GPL Version 2
@@ -26,6 +28,8 @@ MODULE_AUTHOR("John Allwine");
 MODULE_DESCRIPTION("Homing routines for ClearPath motors.");
 MODULE_LICENSE("GPL");
 
+#define MAX_HISTORY 100
+
 typedef enum {
   UNPOWERED,
   POWERED,
@@ -49,6 +53,8 @@ typedef struct {
   hal_float_t *feedback;    // feedback from motor, the duty cycle
   hal_bit_t *home_switch;   // used for specific angle homing (first home to switch, then go to specific angle)
   hal_u32_t *type;          // type of homing sequence (hardstop or continuous)
+  hal_float_t *position;    // commanded or feedback position of the axis
+  hal_bit_t *reset_history; // clear the home position history
 
   // output pins
   hal_bit_t *trigger_home;    // pulsed to trigger built in MachineKit homing
@@ -58,9 +64,20 @@ typedef struct {
   hal_float_t *speed;           // speed of movement   
   hal_bit_t *enable;          // connect to enable pin for specific axis
 
+  // hard stop position statistics over the last history homes
+  hal_float_t *home_position;           // position at the stall onset of the last home
+  hal_float_t *home_position_mean;
+  hal_float_t *home_position_stddev;
+  hal_float_t *home_position_deviation; // home_position - home_position_mean
+  hal_u32_t *home_count;                // number of homes in the history
+
   state_t state;
   uint32_t cycles;
   uint32_t cycles_homed;
+
+  double stall_position;  // position on the first cycle of the current feedback == 0 run
+  double *positions;      // ring of the last history captured positions
+  int next_position;
 } axis_t;
 
 typedef struct {
@@ -76,11 +93,56 @@ static int num_axes = 1; // determined by the axes input
 static char* axes = "x";
 RTAPI_MP_STRING(axes, "Labels for each axis. Each character will represent an axis. Default: x.");
 
+static int history = 10;
+RTAPI_MP_INT(history, "Number of home positions used for the repeatability statistics. Default: 10.");
+
 static const char *modname = "clearpath_homing";
 static int comp_id;
 
+static void reset_history(axis_t *axis) {
+  axis->next_position = 0;
+  *(axis->home_position) = 0;
+  *(axis->home_position_mean) = 0;
+  *(axis->home_position_stddev) = 0;
+  *(axis->home_position_deviation) = 0;
+  *(axis->home_count) = 0;
+}
+
+// Adds the stall position of a completed home to the history and updates the
+// statistics. Only runs once per home, so the history is summed directly.
+static void record_home(axis_t *axis) {
+  axis->positions[axis->next_position] = axis->stall_position;
+  axis->next_position = (axis->next_position+1) % history;
+  if(*(axis->home_count) < history) {
+    *(axis->home_count) += 1;
+  }
+
+  const int count = *(axis->home_count);
+  double sum = 0;
+  for(int i = 0; i < count; i++) {
+    sum += axis->positions[i];
+  }
+  const double mean = sum/count;
+
+  double squares = 0;
+  for(int i = 0; i < count; i++) {
+    const double d = axis->positions[i]-mean;
+    squares += d*d;
+  }
+
+  *(axis->home_position) = axis->stall_position;
+  *(axis->home_position_mean) = mean;
+  *(axis->home_position_stddev) = count > 1 ? rtapi_sqrt(squares/(count-1)) : 0;
+  *(axis->home_position_deviation) = axis->stall_position-mean;
+}
+
 static void update(void *arg, long period) {
   for(int i = 0; i < num_axes; i++) {
+    if(*(data->axis[i].reset_history)) {
+      reset_history(&(data->axis[i]));
+      *(data->axis[i].reset_history) = 0;
+    }
+
     const bool machine_on = *(data->machine_on);
     const type_t type = *(data->axis[i].type);
     const bool start_homing = *(data->axis[i].start_homing);
@@ -126,6 +188,7 @@ static void update(void *arg, long period) {
             case HOMING:
               if(data->axis[i].cycles_homed >= 1000) { 
                 new_state = STOP_MOVING;
+                record_home(&(data->axis[i]));
                 rtapi_print_msg(RTAPI_MSG_DBG, "%s: In HOMING state. feedback == 0 for 1000 cycles. Transitioning to STOP_MOVING state.", modname);
               }
               break;
@@ -214,6 +277,9 @@ static void update(void *arg, long period) {
             break;
           case HOMING:
             if(feedback == 0) {
+              if(data->axis[i].cycles_homed == 0) {
+                data->axis[i].stall_position = *(data->axis[i].position);
+              }
               data->axis[i].cycles_homed++;
             } else {
               data->axis[i].cycles_homed = 0;
@@ -270,6 +336,12 @@ int rtapi_app_main(void) {
 
   num_axes = strlen(axes);
 
+  if(history < 1 || history > MAX_HISTORY) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: history must be between 1 and %d", modname, MAX_HISTORY);
+    hal_exit(comp_id);
+    return -1;
+  }
+
   data = hal_malloc(sizeof(clearpath_t));
   data->axis = hal_malloc(sizeof(axis_t)*num_axes);
 
@@ -360,6 +432,55 @@ int rtapi_app_main(void) {
       return -1;
     }
 
+    retval = hal_pin_float_newf(HAL_IN, &(data->axis[i].position), comp_id, "%s.%c.position", modname, axes[i]);
+    if(retval < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.%c.position", modname, modname, axes[i]);
+      hal_exit(comp_id);
+      return -1;
+    }
+
+    retval = hal_pin_bit_newf(HAL_IO, &(data->axis[i].reset_history), comp_id, "%s.%c.reset_history", modname, axes[i]);
+    if(retval < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.%c.reset_history", modname, modname, axes[i]);
+      hal_exit(comp_id);
+      return -1;
+    }
+
+    retval = hal_pin_float_newf(HAL_OUT, &(data->axis[i].home_position), comp_id, "%s.%c.home_position", modname, axes[i]);
+    if(retval < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.%c.home_position", modname, modname, axes[i]);
+      hal_exit(comp_id);
+      return -1;
+    }
+
+    retval = hal_pin_float_newf(HAL_OUT, &(data->axis[i].home_position_mean), comp_id, "%s.%c.home_position_mean", modname, axes[i]);
+    if(retval < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.%c.home_position_mean", modname, modname, axes[i]);
+      hal_exit(comp_id);
+      return -1;
+    }
+
+    retval = hal_pin_float_newf(HAL_OUT, &(data->axis[i].home_position_stddev), comp_id, "%s.%c.home_position_stddev", modname, axes[i]);
+    if(retval < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.%c.home_position_stddev", modname, modname, axes[i]);
+      hal_exit(comp_id);
+      return -1;
+    }
+
+    retval = hal_pin_float_newf(HAL_OUT, &(data->axis[i].home_position_deviation), comp_id, "%s.%c.home_position_deviation", modname, axes[i]);
+    if(retval < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.%c.home_position_deviation", modname, modname, axes[i]);
+      hal_exit(comp_id);
+      return -1;
+    }
+
+    retval = hal_pin_u32_newf(HAL_OUT, &(data->axis[i].home_count), comp_id, "%s.%c.home_count", modname, axes[i]);
+    if(retval < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.%c.home_count", modname, modname, axes[i]);
+      hal_exit(comp_id);
+      return -1;
+    }
+
     *(data->axis[i].start_homing)       = 0;
     *(data->axis[i].feedback)    = 0;
     *(data->axis[i].home_switch) = 0;
@@ -370,11 +491,17 @@ int rtapi_app_main(void) {
     *(data->axis[i].moving)      = 0;
     *(data->axis[i].speed)       = 0;
     *(data->axis[i].enable)      = 0;
+    *(data->axis[i].position)    = 0;
+    *(data->axis[i].reset_history) = 0;
+
+    data->axis[i].positions = hal_malloc(sizeof(double)*history);
+    data->axis[i].stall_position = 0;
+    reset_history(&(data->axis[i]));
   }
 
   char name[30];
   rtapi_snprintf(name, sizeof(name), "%s.funct", modname);
-  retval = hal_export_funct(name, update, NULL, 0, 0, comp_id);
+  retval = hal_export_funct(name, update, NULL, 1, 0, comp_id);
   if(retval < 0) {
     rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: exporting funct failed", modname);
     hal_exit(comp_id);
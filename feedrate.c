@@ -4,6 +4,26 @@
 *               takes X, Y, Z, B and C velocities and outputs
 *               a single feed rate that represents the speed
 *               of the tool tip relative to the work piece.
+*               With contour=1, it also takes feedback joint
+*               positions and reports the contouring error, the
+*               distance between the commanded and actual tool tip
+*               in work piece coordinates.
+*               Given the requested feed rate, it also tracks how
+*               long and how far the machine runs below a fraction
+*               of it.
+*               With odometer=1, the tool tip path length and each
+*               joint's travel and direction reversals are
+*               accumulated for maintenance scheduling. They're IO
+*               pins so feedrate-odometer can save them and restore
+*               them on start up.
+*               With tool_points=N, it also takes the tool radius,
+*               flute count, spindle speed and N heights along the
+*               tool axis and outputs the fastest feed of those
+*               points, the surface speed and the chip load.
+*               With orientation=1, the tool axis direction in work
+*               piece coordinates and the rate and acceleration of
+*               the rotation are output to find orientations where B
+*               and C move quickly.
 *
 * Author: John Allwine <john@pocketnc.com>
 * License: GPL Version 2
@@ -39,6 +59,19 @@ MODULE_LICENSE("GPL");
   }
 
 
+#define NUM_JOINTS 5
+
+// Travel and direction reversals of a joint. A reversal is counted once the
+// joint moves back more than the deadband from the furthest point it
+// reached in its current direction, so small dithering isn't counted.
+typedef struct {
+  hal_float_t *travel;
+  hal_u64_t *reversals;
+  double last;
+  double extreme;
+  int direction;  // 1, -1 or 0 before the joint first moves
+} odometer_t;
+
 typedef struct {
   float lastX;
   float lastY;
@@ -58,6 +91,76 @@ typedef struct {
   hal_float_t *zv;
   hal_float_t *bv;
   hal_float_t *cv;
+
+  // Tool axis unit vector in work piece coordinates, and the magnitude of
+  // the angular velocity and acceleration of the work piece in deg/s and
+  // deg/s^2, only with orientation=1. The trig of C is only recomputed
+  // when C changes.
+  hal_float_t *tool_axis_x;
+  hal_float_t *tool_axis_y;
+  hal_float_t *tool_axis_z;
+  hal_float_t *angular_velocity;
+  hal_float_t *angular_accel;
+  float lastOmegaX;
+  float lastOmegaY;
+  float lastOmegaZ;
+  float lastAxisC;
+  float axisCC;
+  float axisSC;
+
+  hal_bit_t *reset;          // clears the peak and accumulated statistics
+
+  // Tracking of the feed rate against the requested feed rate, connect to
+  // motion.requested-vel. Time and distance are only accumulated while
+  // requested is above 0.
+  hal_float_t *requested;
+  hal_float_t *feed_ratio;    // feedrate/requested, 0 when nothing is requested
+  hal_float_t *slow_fraction; // running below slow_fraction*requested counts as slow
+  hal_float_t *feed_time;     // seconds with a requested feed rate
+  hal_float_t *slow_time;     // seconds running slow
+  hal_float_t *slow_distance; // tool tip distance while running slow
+  long long feedTimeNs;
+  long long slowTimeNs;
+  double slowDistance;
+
+  // Odometry, only with odometer=1, of the x, y, z, b and c joints, z
+  // without the tool length. Travel is in machine units, or degrees for b
+  // and c. Cycles where a joint moves faster than the max velocity, such as
+  // a position jump when homing, or where tz changes aren't counted.
+  hal_float_t *path_length;          // tool tip distance relative to the work piece
+  hal_float_t *linear_deadband;
+  hal_float_t *angular_deadband;
+  hal_float_t *max_linear_velocity;  // units/s
+  hal_float_t *max_angular_velocity; // deg/s
+  odometer_t odometers[NUM_JOINTS];
+  hal_float_t lastTz;
+  bool started;                      // the first cycle only sets the last positions
+
+  // Contouring error, only with contour=1. Feedback positions are in the
+  // same units as x, y, z, b and c, and tz applies to both.
+  hal_float_t *x_fb;
+  hal_float_t *y_fb;
+  hal_float_t *z_fb;
+  hal_float_t *b_fb;
+  hal_float_t *c_fb;
+  hal_float_t *error_x;      // feedback minus commanded tool tip, in work piece coordinates
+  hal_float_t *error_y;
+  hal_float_t *error_z;
+  hal_float_t *error;        // magnitude of the error vector
+  hal_float_t *error_peak;
+  hal_float_t *error_rms;
+  double errorSumSquares;
+  long long errorSamples;
+
+  // Cutting edge feed, only with tool_points > 0. Heights are measured up
+  // the tool axis from the tool tip.
+  hal_float_t *tool_radius;
+  hal_u32_t *flutes;
+  hal_float_t *spindle_rpm;
+  hal_float_t **point_heights;
+  hal_float_t *edge_feed;     // fastest feed rate of the points
+  hal_float_t *surface_speed; // in units per second, like feedrate
+  hal_float_t *chip_load;     // edge_feed per tooth, 0 if the spindle is stopped
 } data_t;
 
 static data_t *data;
@@ -65,7 +168,159 @@ static data_t *data;
 static const char *modname = "feedrate";
 static int comp_id;
 
+static int contour = 0;
+RTAPI_MP_INT(contour, "Set to 1 to add feedback position pins and contouring error outputs. Default: 0.");
+
+#define MAX_TOOL_POINTS 8
+static int tool_points = 0;
+RTAPI_MP_INT(tool_points, "Number of points along the tool axis to compute the cutting edge feed at, up to 8. Default: 0.");
+
+static int orientation = 0;
+RTAPI_MP_INT(orientation, "Set to 1 to add tool axis direction and angular velocity and acceleration pins. Default: 0.");
+
+static int odometer = 0;
+RTAPI_MP_INT(odometer, "Set to 1 to add path length and joint travel and reversal pins. Default: 0.");
+
+// Position of the tool tip relative to the work piece, rotating the machine
+// coordinates back through the B and C rotations, Ry(-B) then Rz(-C). Done
+// in double precision as errors are a few microns on positions hundreds of
+// millimeters from the rotary centers.
+static void workpiece_position(double x, double y, double z, double b, double c, double *p) {
+  const double B = b*PI/180;
+  const double C = c*PI/180;
+  const double CB = rtapi_cos(-B);
+  const double SB = rtapi_sin(-B);
+  const double CC = rtapi_cos(-C);
+  const double SC = rtapi_sin(-C);
+
+  const double bx = CB*x+SB*z;
+  const double by = y;
+  const double bz = -SB*x+CB*z;
+
+  p[0] = CC*bx-SC*by;
+  p[1] = SC*bx+CC*by;
+  p[2] = bz;
+}
+
+static void update_contour(void) {
+  double commanded[3];
+  double actual[3];
+  const double tz = *(data->tz);
+  workpiece_position(*(data->x), *(data->y), *(data->z)-tz, *(data->b), *(data->c), commanded);
+  workpiece_position(*(data->x_fb), *(data->y_fb), *(data->z_fb)-tz, *(data->b_fb), *(data->c_fb), actual);
+
+  const double ex = actual[0]-commanded[0];
+  const double ey = actual[1]-commanded[1];
+  const double ez = actual[2]-commanded[2];
+  const double squared = ex*ex+ey*ey+ez*ez;
+  const double error = rtapi_sqrt(squared);
+
+  data->errorSumSquares += squared;
+  data->errorSamples++;
+
+  *(data->error_x) = ex;
+  *(data->error_y) = ey;
+  *(data->error_z) = ez;
+  *(data->error) = error;
+  if(error > *(data->error_peak)) {
+    *(data->error_peak) = error;
+  }
+  *(data->error_rms) = rtapi_sqrt(data->errorSumSquares/data->errorSamples);
+}
+
+static const char jointNames[NUM_JOINTS] = { 'x', 'y', 'z', 'b', 'c' };
+
+// Moves the odometer to position without counting the move.
+static void skip_odometer(odometer_t *odometer, double position) {
+  odometer->last = position;
+  odometer->extreme = position;
+}
+
+static void update_odometer(odometer_t *odometer, double position, double deadband) {
+  *(odometer->travel) += rtapi_fabs(position-odometer->last);
+  odometer->last = position;
+
+  if(odometer->direction != 0 && odometer->direction*(position-odometer->extreme) >= 0) {
+    odometer->extreme = position;
+  } else if(rtapi_fabs(position-odometer->extreme) > deadband) {
+    if(odometer->direction != 0) {
+      *(odometer->reversals) += 1;
+    }
+    odometer->direction = position > odometer->extreme ? 1 : -1;
+    odometer->extreme = position;
+  }
+}
+
+// feedrate*dt is the distance moved this cycle, as feedrate is computed with
+// dt. The max move per cycle comes from the real period, so full speed moves
+// in threads slower than 1 kHz aren't taken for jumps.
+static void update_odometry(float feedrate, float dt, long period) {
+  const double joints[NUM_JOINTS] = { *(data->x), *(data->y), *(data->z), *(data->b), *(data->c) };
+  const double cycleTime = period*1e-9;
+  const double maxLinear = *(data->max_linear_velocity)*cycleTime;
+  const double maxAngular = *(data->max_angular_velocity)*cycleTime;
+
+  bool jumped = !data->started || *(data->tz) != data->lastTz;
+  for(int i = 0; i < NUM_JOINTS; i++) {
+    if(rtapi_fabs(joints[i]-data->odometers[i].last) > (i < 3 ? maxLinear : maxAngular)) {
+      jumped = true;
+    }
+  }
+  data->lastTz = *(data->tz);
+
+  if(jumped) {
+    for(int i = 0; i < NUM_JOINTS; i++) {
+      skip_odometer(&(data->odometers[i]), joints[i]);
+    }
+    return;
+  }
+
+  *(data->path_length) += feedrate*dt;
+  for(int i = 0; i < NUM_JOINTS; i++) {
+    update_odometer(&(data->odometers[i]), joints[i], i < 3 ? *(data->linear_deadband) : *(data->angular_deadband));
+  }
+}
+
+static void update_orientation(float C, float CB, float SB, float omegaX, float omegaY, float omegaZ, float dt) {
+  if(C != data->lastAxisC) {
+    data->lastAxisC = C;
+    data->axisCC = rtapi_cos(-C);
+    data->axisSC = rtapi_sin(-C);
+  }
+
+  // (0,0,1) rotated like workpiece_position
+  *(data->tool_axis_x) = data->axisCC*SB;
+  *(data->tool_axis_y) = data->axisSC*SB;
+  *(data->tool_axis_z) = CB;
+  *(data->angular_velocity) = rtapi_sqrt(omegaX*omegaX+omegaY*omegaY+omegaZ*omegaZ)*180/PI;
+  if(data->started) {
+    const float ax = (omegaX-data->lastOmegaX)/dt;
+    const float ay = (omegaY-data->lastOmegaY)/dt;
+    const float az = (omegaZ-data->lastOmegaZ)/dt;
+    *(data->angular_accel) = rtapi_sqrt(ax*ax+ay*ay+az*az)*180/PI;
+  }
+  data->lastOmegaX = omegaX;
+  data->lastOmegaY = omegaY;
+  data->lastOmegaZ = omegaZ;
+}
+
 static void update(void *arg, long period) {
+  if(*(data->reset)) {
+    data->feedTimeNs = 0;
+    data->slowTimeNs = 0;
+    data->slowDistance = 0;
+    *(data->feed_time) = 0;
+    *(data->slow_time) = 0;
+    *(data->slow_distance) = 0;
+    if(contour) {
+      *(data->error_peak) = 0;
+      *(data->error_rms) = 0;
+      data->errorSumSquares = 0;
+      data->errorSamples = 0;
+    }
+    *(data->reset) = 0;
+  }
+
   const float X = *(data->x);
   const float Y = *(data->y);
   const float Z = *(data->z)-*(data->tz);
@@ -88,6 +343,10 @@ static void update(void *arg, long period) {
   const float omegaY = bv;
   const float omegaZ = CB*cv;
 
+  if(orientation) {
+    update_orientation(C, CB, SB, omegaX, omegaY, omegaZ, dt);
+  }
+
   // linear velocity
   const float lx = xv;
   const float ly = yv;
@@ -105,6 +364,27 @@ static void update(void *arg, long period) {
 
   const float feedrate = rtapi_sqrt((vx*vx)+(vy*vy)+(vz*vz)); 
   *(data->feedrate) = feedrate;
+
+  if(tool_points > 0) {
+    // A point h up the tool axis adds (0,0,h) cross omega to the tool tip's
+    // velocity.
+    float maxSquared = 0;
+    for(int i = 0; i < tool_points; i++) {
+      const float h = *(data->point_heights[i]);
+      const float px = vx-h*omegaY;
+      const float py = vy+h*omegaX;
+      const float squared = px*px+py*py+vz*vz;
+      if(squared > maxSquared) {
+        maxSquared = squared;
+      }
+    }
+    const float edgeFeed = rtapi_sqrt(maxSquared);
+    const float rps = rtapi_fabs(*(data->spindle_rpm))/60;
+    const float teethPerSecond = rps*(*(data->flutes));
+    *(data->edge_feed) = edgeFeed;
+    *(data->surface_speed) = 2*PI*(*(data->tool_radius))*rps;
+    *(data->chip_load) = teethPerSecond > 0 ? edgeFeed/teethPerSecond : 0;
+  }
   *(data->xv) = xv;
   *(data->yv) = yv;
   *(data->zv) = zv;
@@ -116,6 +396,30 @@ static void update(void *arg, long period) {
   data->lastZ = Z;
   data->lastB = B;
   data->lastC = C;
+
+  if(odometer) {
+    update_odometry(feedrate, dt, period);
+  }
+  data->started = true;
+
+  const hal_float_t requested = *(data->requested);
+  if(requested > 0) {
+    *(data->feed_ratio) = feedrate/requested;
+    data->feedTimeNs += period;
+    *(data->feed_time) = data->feedTimeNs*1e-9;
+    if(feedrate < *(data->slow_fraction)*requested) {
+      data->slowTimeNs += period;
+      data->slowDistance += feedrate*dt;
+      *(data->slow_time) = data->slowTimeNs*1e-9;
+      *(data->slow_distance) = data->slowDistance;
+    }
+  } else {
+    *(data->feed_ratio) = 0;
+  }
+
+  if(contour) {
+    update_contour();
+  }
 }
 
 int rtapi_app_main(void) {
@@ -140,6 +444,105 @@ int rtapi_app_main(void) {
   PIN(float, HAL_OUT, zv, zv);
   PIN(float, HAL_OUT, bv, bv);
   PIN(float, HAL_OUT, cv, cv);
+  PIN(bit, HAL_IO, reset, reset);
+
+  PIN(float, HAL_IN, requested, requested);
+  PIN(float, HAL_OUT, feed_ratio, feed-ratio);
+  PIN(float, HAL_IN, slow_fraction, slow-fraction);
+  PIN(float, HAL_OUT, feed_time, feed-time);
+  PIN(float, HAL_OUT, slow_time, slow-time);
+  PIN(float, HAL_OUT, slow_distance, slow-distance);
+
+  if(odometer) {
+    PIN(float, HAL_IO, path_length, path-length);
+    PIN(float, HAL_IN, linear_deadband, linear-deadband);
+    PIN(float, HAL_IN, angular_deadband, angular-deadband);
+    PIN(float, HAL_IN, max_linear_velocity, max-linear-velocity);
+    PIN(float, HAL_IN, max_angular_velocity, max-angular-velocity);
+    for(int i = 0; i < NUM_JOINTS; i++) {
+      retval = hal_pin_float_newf(HAL_IO, &(data->odometers[i].travel), comp_id, "%s.%c-travel", modname, jointNames[i]);
+      if(retval < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.%c-travel", modname, modname, jointNames[i]);
+        hal_exit(comp_id);
+        return -1;
+      }
+      retval = hal_pin_u64_newf(HAL_IO, &(data->odometers[i].reversals), comp_id, "%s.%c-reversals", modname, jointNames[i]);
+      if(retval < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.%c-reversals", modname, modname, jointNames[i]);
+        hal_exit(comp_id);
+        return -1;
+      }
+      *(data->odometers[i].travel) = 0;
+      *(data->odometers[i].reversals) = 0;
+      data->odometers[i].direction = 0;
+    }
+
+    *(data->path_length) = 0;
+    *(data->linear_deadband) = .01;
+    *(data->angular_deadband) = .01;
+    *(data->max_linear_velocity) = 500;
+    *(data->max_angular_velocity) = 3600;
+  }
+
+  if(contour) {
+    PIN(float, HAL_IN, x_fb, x-fb);
+    PIN(float, HAL_IN, y_fb, y-fb);
+    PIN(float, HAL_IN, z_fb, z-fb);
+    PIN(float, HAL_IN, b_fb, b-fb);
+    PIN(float, HAL_IN, c_fb, c-fb);
+    PIN(float, HAL_OUT, error_x, error-x);
+    PIN(float, HAL_OUT, error_y, error-y);
+    PIN(float, HAL_OUT, error_z, error-z);
+    PIN(float, HAL_OUT, error, error);
+    PIN(float, HAL_OUT, error_peak, error-peak);
+    PIN(float, HAL_OUT, error_rms, error-rms);
+
+    *(data->x_fb) = 0;
+    *(data->y_fb) = 0;
+    *(data->z_fb) = 0;
+    *(data->b_fb) = 0;
+    *(data->c_fb) = 0;
+    *(data->error_x) = 0;
+    *(data->error_y) = 0;
+    *(data->error_z) = 0;
+    *(data->error) = 0;
+    *(data->error_peak) = 0;
+    *(data->error_rms) = 0;
+    data->errorSumSquares = 0;
+    data->errorSamples = 0;
+  }
+
+  if(tool_points < 0 || tool_points > MAX_TOOL_POINTS) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: tool_points must be between 0 and %d\n", modname, MAX_TOOL_POINTS);
+    hal_exit(comp_id);
+    return -1;
+  }
+  if(tool_points > 0) {
+    PIN(float, HAL_IN, tool_radius, tool-radius);
+    PIN(u32, HAL_IN, flutes, flutes);
+    PIN(float, HAL_IN, spindle_rpm, spindle-rpm);
+    PIN(float, HAL_OUT, edge_feed, edge-feed);
+    PIN(float, HAL_OUT, surface_speed, surface-speed);
+    PIN(float, HAL_OUT, chip_load, chip-load);
+
+    data->point_heights = hal_malloc(tool_points*sizeof(hal_float_t *));
+    for(int i = 0; i < tool_points; i++) {
+      retval = hal_pin_float_newf(HAL_IN, &(data->point_heights[i]), comp_id, "%s.point-height-%d", modname, i);
+      if(retval < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.point-height-%d", modname, modname, i);
+        hal_exit(comp_id);
+        return -1;
+      }
+      *(data->point_heights[i]) = 0;
+    }
+
+    *(data->tool_radius) = 0;
+    *(data->flutes) = 0;
+    *(data->spindle_rpm) = 0;
+    *(data->edge_feed) = 0;
+    *(data->surface_speed) = 0;
+    *(data->chip_load) = 0;
+  }
 
   *(data->x) = 0;
   *(data->y) = 0;
@@ -152,6 +555,40 @@ int rtapi_app_main(void) {
   *(data->zv) = 0;
   *(data->bv) = 0;
   *(data->cv) = 0;
+  *(data->reset) = 0;
+
+  if(orientation) {
+    PIN(float, HAL_OUT, tool_axis_x, tool-axis-x);
+    PIN(float, HAL_OUT, tool_axis_y, tool-axis-y);
+    PIN(float, HAL_OUT, tool_axis_z, tool-axis-z);
+    PIN(float, HAL_OUT, angular_velocity, angular-velocity);
+    PIN(float, HAL_OUT, angular_accel, angular-accel);
+
+    *(data->tool_axis_x) = 0;
+    *(data->tool_axis_y) = 0;
+    *(data->tool_axis_z) = 1;
+    *(data->angular_velocity) = 0;
+    *(data->angular_accel) = 0;
+    data->lastOmegaX = 0;
+    data->lastOmegaY = 0;
+    data->lastOmegaZ = 0;
+    // matches C starting at 0
+    data->lastAxisC = 0;
+    data->axisCC = 1;
+    data->axisSC = 0;
+  }
+
+  *(data->requested) = 0;
+  *(data->feed_ratio) = 0;
+  *(data->slow_fraction) = .9;
+  *(data->feed_time) = 0;
+  *(data->slow_time) = 0;
+  *(data->slow_distance) = 0;
+  data->feedTimeNs = 0;
+  data->slowTimeNs = 0;
+  data->slowDistance = 0;
+
+  data->started = false;
 
   char name[20];
   rtapi_snprintf(name, sizeof(name), "%s.funct", modname);
@@ -0,0 +1,223 @@
+/********************************************************************
+* Description:  gateN
+* A HAL component for performing and, or, xor, nand, nor, k of n
+* threshold or majority logic with up to 128 boolean inputs.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#include "rtapi.h"              /* RTAPI realtime OS API */
+#include "rtapi_app.h"          /* RTAPI realtime module decls */
+#include "rtapi_errno.h"        /* EINVAL etc */
+#include "hal.h"                /* HAL public API decls */
+#include "hal_priv.h"
+#include <sys/mman.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+
+#define MAX_NUM_INPUTS 128
+
+// Inputs are packed into 64 bit words and counted with popcount, so every
+// mode reduces to a comparison on the number of high inputs.
+#define WORD_BITS 64
+
+MODULE_AUTHOR("John Allwine");
+MODULE_DESCRIPTION("Combine up to 128 inputs with and, or, xor, nand, nor, threshold or majority logic.");
+MODULE_LICENSE("GPL");
+
+typedef struct {
+  hal_bit_t **inputs;
+  hal_bit_t *output;
+  hal_s32_t *activeCount;  // number of inputs that are high
+  int numInputs;
+  int threshold;
+} data_t;
+
+static const char *modname = "gateN";
+static int comp_id;
+
+static int inputs = 2;
+RTAPI_IP_INT(inputs, "number of input HAL pins");
+
+static char *mode = "and";
+RTAPI_IP_STRING(mode, "and, or, xor, nand, nor, threshold or majority. Default: and.");
+
+static int threshold = 1;
+RTAPI_IP_INT(threshold, "number of inputs that must be high for the output to be high in threshold mode");
+
+static int defaultValue = -1;
+RTAPI_IP_INT(defaultValue, "default state of inputs, 0 or 1. Defaults to 1 in and and nand modes, 0 otherwise.");
+
+static inline int count_inputs(data_t *data) {
+  int count = 0;
+  for(int base = 0; base < data->numInputs; base += WORD_BITS) {
+    const int n = data->numInputs-base < WORD_BITS ? data->numInputs-base : WORD_BITS;
+
+    uint64_t word = 0;
+    for(int i = 0; i < n; i++) {
+      word |= (uint64_t)(*(data->inputs[base+i]) != 0) << i;
+    }
+    count += __builtin_popcountll(word);
+  }
+
+  *(data->activeCount) = count;
+  return count;
+}
+
+static int update_and(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+  *(data->output) = count_inputs(data) == data->numInputs;
+  return 0;
+}
+
+static int update_or(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+  *(data->output) = count_inputs(data) != 0;
+  return 0;
+}
+
+static int update_xor(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+  *(data->output) = count_inputs(data) & 1;
+  return 0;
+}
+
+static int update_nand(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+  *(data->output) = count_inputs(data) != data->numInputs;
+  return 0;
+}
+
+static int update_nor(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+  *(data->output) = count_inputs(data) == 0;
+  return 0;
+}
+
+static int update_threshold(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+  *(data->output) = count_inputs(data) >= data->threshold;
+  return 0;
+}
+
+static int update_majority(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+  *(data->output) = count_inputs(data)*2 > data->numInputs;
+  return 0;
+}
+
+static int instantiate_instance(const int argc, char* const *argv) {
+  data_t *data;
+  const char* instname = argv[1];
+  int r;
+
+  if(inputs < 2) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': inputs must be greater than or equal to 2\n", modname, instname);
+    return -1;
+  }
+  if(inputs > MAX_NUM_INPUTS) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': inputs must be less than or equal to %d\n", modname, instname, MAX_NUM_INPUTS);
+    return -1;
+  }
+
+  hal_xfunct_t update;
+  int defaultInput = 0;
+  if(strcmp(mode, "and") == 0) {
+    update = update_and;
+    defaultInput = 1;
+  } else if(strcmp(mode, "or") == 0) {
+    update = update_or;
+  } else if(strcmp(mode, "xor") == 0) {
+    update = update_xor;
+  } else if(strcmp(mode, "nand") == 0) {
+    update = update_nand;
+    defaultInput = 1;
+  } else if(strcmp(mode, "nor") == 0) {
+    update = update_nor;
+  } else if(strcmp(mode, "threshold") == 0) {
+    update = update_threshold;
+    if(threshold < 0 || threshold > inputs) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': threshold must be between 0 and %d\n", modname, instname, inputs);
+      return -1;
+    }
+  } else if(strcmp(mode, "majority") == 0) {
+    update = update_majority;
+  } else {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': unknown mode '%s'\n", modname, instname, mode);
+    return -1;
+  }
+  if(defaultValue >= 0) {
+    defaultInput = (defaultValue != 0);
+  }
+
+  int inst_id = hal_inst_create(instname, comp_id, sizeof(data_t), (void**)&data);
+  if(inst_id < 0) {
+    return -1;
+  }
+
+  data->numInputs = inputs;
+  data->threshold = threshold;
+  data->inputs = hal_malloc(inputs*sizeof(hal_bit_t *));
+
+  for(int i = 0; i < inputs; i++) {
+    r = hal_pin_bit_newf(HAL_IN, &(data->inputs[i]), inst_id, "%s.in%d", instname,i);
+    if(r < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.in%d'\n", modname, instname, i);
+      return r;
+    }
+    *(data->inputs[i]) = defaultInput;
+  }
+
+  r = hal_pin_bit_newf(HAL_OUT, &(data->output), inst_id, "%s.out", instname);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.out'\n", modname, instname);
+    return r;
+  }
+
+  r = hal_pin_s32_newf(HAL_OUT, &(data->activeCount), inst_id, "%s.active-count", instname);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.active-count'\n", modname, instname);
+    return r;
+  }
+
+  *(data->output) = 0;
+  *(data->activeCount) = 0;
+
+  hal_export_xfunct_args_t updateArgs = {
+    .type = FS_XTHREADFUNC,
+    .funct.x = update,
+    .arg = data,
+    .uses_fp = 0,
+    .reentrant = 0,
+    .owner_id = inst_id
+  };
+  r = hal_export_xfunctf(&updateArgs, "%s.funct", instname);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: function export failed: %s\n", modname, instname);
+    return r;
+  }
+
+  return 0;
+}
+
+int rtapi_app_main(void) {
+  comp_id = hal_xinit(TYPE_RT, 0, 0, instantiate_instance, NULL, modname);
+  if(comp_id < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: hal_init() failed\n", modname);
+    return -1;
+  }
+
+  hal_ready(comp_id);
+  return 0;
+}
+
+void rtapi_app_exit(void) {
+  hal_exit(comp_id);
+}
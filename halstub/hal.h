@@ -0,0 +1,91 @@
+/********************************************************************
+* Description:  hal.h
+*               Userspace stand-in for the parts of the HAL API used
+*               by the components in this repository. See halstub.h.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#ifndef HALSTUB_HAL_H
+#define HALSTUB_HAL_H
+
+#include "rtapi.h"
+
+#define HAL_NAME_LEN 47
+
+typedef volatile bool hal_bit_t;
+typedef volatile uint32_t hal_u32_t;
+typedef volatile int32_t hal_s32_t;
+typedef volatile uint64_t hal_u64_t;
+typedef volatile int64_t hal_s64_t;
+typedef volatile double hal_float_t;
+
+typedef enum {
+  HAL_BIT = 1,
+  HAL_FLOAT,
+  HAL_S32,
+  HAL_U32,
+  HAL_S64,
+  HAL_U64
+} hal_type_t;
+
+typedef enum {
+  HAL_IN = 16,
+  HAL_OUT = 32,
+  HAL_IO = (HAL_IN | HAL_OUT)
+} hal_pin_dir_t;
+
+#define TYPE_RT 1
+
+typedef struct {
+  long period;
+} hal_funct_args_t;
+
+static inline long fa_period(const hal_funct_args_t *fa) {
+  return fa->period;
+}
+
+typedef int (*hal_xfunct_t)(void *arg, const hal_funct_args_t *fa);
+
+typedef enum {
+  FS_LEGACY_THREADFUNC,
+  FS_XTHREADFUNC
+} hal_funct_signature_t;
+
+typedef struct {
+  hal_funct_signature_t type;
+  union {
+    void (*l)(void *, long);
+    hal_xfunct_t x;
+  } funct;
+  void *arg;
+  int uses_fp;
+  int reentrant;
+  int owner_id;
+} hal_export_xfunct_args_t;
+
+typedef int (*hal_constructor_t)(const int argc, char* const *argv);
+typedef int (*hal_destructor_t)(const char *name, void *inst, const int size);
+
+int hal_init(const char *name);
+int hal_xinit(const int type, const int userarg1, const int userarg2, const hal_constructor_t ctor, const hal_destructor_t dtor, const char *name);
+int hal_ready(int comp_id);
+int hal_exit(int comp_id);
+void *hal_malloc(long size);
+int hal_inst_create(const char *name, const int comp_id, const int size, void **inst_data);
+
+int hal_export_funct(const char *name, void (*funct)(void *, long), void *arg, int uses_fp, int reentrant, int comp_id);
+int hal_export_xfunctf(const hal_export_xfunct_args_t *xf, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+int hal_pin_bit_newf(hal_pin_dir_t dir, hal_bit_t **data_ptr_addr, int owner_id, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+int hal_pin_float_newf(hal_pin_dir_t dir, hal_float_t **data_ptr_addr, int owner_id, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+int hal_pin_s32_newf(hal_pin_dir_t dir, hal_s32_t **data_ptr_addr, int owner_id, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+int hal_pin_u32_newf(hal_pin_dir_t dir, hal_u32_t **data_ptr_addr, int owner_id, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+int hal_pin_s64_newf(hal_pin_dir_t dir, hal_s64_t **data_ptr_addr, int owner_id, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+int hal_pin_u64_newf(hal_pin_dir_t dir, hal_u64_t **data_ptr_addr, int owner_id, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+
+#endif
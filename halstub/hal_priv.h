@@ -0,0 +1,18 @@
+/********************************************************************
+* Description:  hal_priv.h
+*               Userspace stand-in, see halstub.h. Nothing private is
+*               used by the components.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#ifndef HALSTUB_HAL_PRIV_H
+#define HALSTUB_HAL_PRIV_H
+
+#include "hal.h"
+
+#endif
@@ -0,0 +1,285 @@
+/********************************************************************
+* Description:  halstub.c
+*               Userspace stand-in for the HAL and RTAPI. See
+*               halstub.h.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#include "halstub.h"
+#include "rtapi_errno.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PINS 4096
+#define MAX_FUNCTS 64
+#define MAX_PARAMS 64
+#define MAX_NAME_LENGTH (HAL_NAME_LEN+1)
+
+typedef struct {
+  char name[MAX_NAME_LENGTH];
+  hal_type_t type;
+  hal_pin_dir_t dir;
+  void *ptr;
+} pin_t;
+
+typedef struct {
+  char name[MAX_NAME_LENGTH];
+  hal_funct_signature_t type;
+  void (*legacy)(void *, long);
+  hal_xfunct_t x;
+  void *arg;
+} funct_t;
+
+typedef struct {
+  const char *name;
+  int *intValue;
+  char **stringValue;
+} param_t;
+
+// Every allocation is kept in a list so halstub_reset can free them.
+typedef struct allocation_t {
+  struct allocation_t *next;
+  char data[] __attribute__((aligned(16)));
+} allocation_t;
+
+static pin_t pins[MAX_PINS];
+static int numPins;
+
+static funct_t functs[MAX_FUNCTS];
+static int numFuncts;
+
+static param_t params[MAX_PARAMS];
+static int numParams;
+
+static allocation_t *allocations;
+
+static const char *componentName = "";
+static hal_constructor_t constructor;
+static msg_level_t msgLevel = RTAPI_MSG_ERR;
+
+void rtapi_print_msg(msg_level_t level, const char *fmt, ...) {
+  if(level > msgLevel) {
+    return;
+  }
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+}
+
+void halstub_set_msg_level(msg_level_t level) {
+  msgLevel = level;
+}
+
+void halstub_register_int(const char *name, int *value) {
+  if(numParams < MAX_PARAMS) {
+    params[numParams++] = (param_t){ .name = name, .intValue = value };
+  }
+}
+
+void halstub_register_string(const char *name, char **value) {
+  if(numParams < MAX_PARAMS) {
+    params[numParams++] = (param_t){ .name = name, .stringValue = value };
+  }
+}
+
+int halstub_set_param(const char *assignment) {
+  const char *equals = strchr(assignment, '=');
+  if(!equals) {
+    return -1;
+  }
+  const size_t length = equals-assignment;
+  for(int i = 0; i < numParams; i++) {
+    if(strlen(params[i].name) == length && strncmp(params[i].name, assignment, length) == 0) {
+      if(params[i].intValue) {
+        *(params[i].intValue) = strtol(equals+1, NULL, 0);
+      } else {
+        *(params[i].stringValue) = strdup(equals+1);
+      }
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int hal_init(const char *name) {
+  componentName = name;
+  return 1;
+}
+
+int hal_xinit(const int type, const int userarg1, const int userarg2, const hal_constructor_t ctor, const hal_destructor_t dtor, const char *name) {
+  componentName = name;
+  constructor = ctor;
+  return 1;
+}
+
+int hal_ready(int comp_id) {
+  return 0;
+}
+
+int hal_exit(int comp_id) {
+  return 0;
+}
+
+void *hal_malloc(long size) {
+  allocation_t *allocation = calloc(1, sizeof(allocation_t)+size);
+  if(!allocation) {
+    return NULL;
+  }
+  allocation->next = allocations;
+  allocations = allocation;
+  return allocation->data;
+}
+
+int hal_inst_create(const char *name, const int comp_id, const int size, void **inst_data) {
+  *inst_data = hal_malloc(size);
+  return *inst_data ? 2 : -ENOMEM;
+}
+
+void halstub_reset(void) {
+  while(allocations) {
+    allocation_t *next = allocations->next;
+    free(allocations);
+    allocations = next;
+  }
+  numPins = 0;
+  numFuncts = 0;
+  componentName = "";
+  constructor = NULL;
+}
+
+bool halstub_instantiable(void) {
+  return constructor != NULL;
+}
+
+const char *halstub_component_name(void) {
+  return componentName;
+}
+
+int halstub_newinst(const char *name, int argc, char **argv) {
+  if(!constructor) {
+    return -1;
+  }
+  char *args[argc+2];
+  args[0] = (char*)componentName;
+  args[1] = (char*)name;
+  for(int i = 0; i < argc; i++) {
+    args[i+2] = argv[i];
+  }
+  return constructor(argc+2, args);
+}
+
+static int add_funct(const char *name, hal_funct_signature_t type, void (*legacy)(void *, long), hal_xfunct_t x, void *arg) {
+  if(numFuncts >= MAX_FUNCTS) {
+    return -ENOMEM;
+  }
+  funct_t *funct = &functs[numFuncts++];
+  snprintf(funct->name, sizeof(funct->name), "%s", name);
+  funct->type = type;
+  funct->legacy = legacy;
+  funct->x = x;
+  funct->arg = arg;
+  return 0;
+}
+
+int hal_export_funct(const char *name, void (*funct)(void *, long), void *arg, int uses_fp, int reentrant, int comp_id) {
+  return add_funct(name, FS_LEGACY_THREADFUNC, funct, NULL, arg);
+}
+
+int hal_export_xfunctf(const hal_export_xfunct_args_t *xf, const char *fmt, ...) {
+  char name[MAX_NAME_LENGTH];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(name, sizeof(name), fmt, args);
+  va_end(args);
+  if(xf->type == FS_XTHREADFUNC) {
+    return add_funct(name, xf->type, NULL, xf->funct.x, xf->arg);
+  }
+  return add_funct(name, xf->type, xf->funct.l, NULL, xf->arg);
+}
+
+static int add_pin(hal_type_t type, hal_pin_dir_t dir, void **ptr, const char *fmt, va_list args) {
+  if(numPins >= MAX_PINS) {
+    return -ENOMEM;
+  }
+  pin_t *pin = &pins[numPins++];
+  vsnprintf(pin->name, sizeof(pin->name), fmt, args);
+  pin->type = type;
+  pin->dir = dir;
+  // every pin type fits in 8 bytes
+  pin->ptr = hal_malloc(8);
+  if(!pin->ptr) {
+    return -ENOMEM;
+  }
+  *ptr = pin->ptr;
+  return 0;
+}
+
+#define PIN_NEWF(name, halType, type) \
+  int hal_pin_##name##_newf(hal_pin_dir_t dir, type **data_ptr_addr, int owner_id, const char *fmt, ...) { \
+    va_list args; \
+    va_start(args, fmt); \
+    const int r = add_pin(halType, dir, (void**)data_ptr_addr, fmt, args); \
+    va_end(args); \
+    return r; \
+  }
+
+PIN_NEWF(bit, HAL_BIT, hal_bit_t)
+PIN_NEWF(float, HAL_FLOAT, hal_float_t)
+PIN_NEWF(s32, HAL_S32, hal_s32_t)
+PIN_NEWF(u32, HAL_U32, hal_u32_t)
+PIN_NEWF(s64, HAL_S64, hal_s64_t)
+PIN_NEWF(u64, HAL_U64, hal_u64_t)
+
+int halstub_num_pins(void) {
+  return numPins;
+}
+
+const char *halstub_pin_name(int pin) {
+  return pins[pin].name;
+}
+
+hal_type_t halstub_pin_type(int pin) {
+  return pins[pin].type;
+}
+
+hal_pin_dir_t halstub_pin_dir(int pin) {
+  return pins[pin].dir;
+}
+
+void *halstub_pin_ptr(int pin) {
+  return pins[pin].ptr;
+}
+
+void *halstub_pin(const char *name) {
+  for(int i = 0; i < numPins; i++) {
+    if(strcmp(pins[i].name, name) == 0) {
+      return pins[i].ptr;
+    }
+  }
+  return NULL;
+}
+
+int halstub_num_functs(void) {
+  return numFuncts;
+}
+
+const char *halstub_funct_name(int funct) {
+  return functs[funct].name;
+}
+
+void halstub_run(int funct, long period) {
+  if(functs[funct].type == FS_XTHREADFUNC) {
+    const hal_funct_args_t fa = { .period = period };
+    functs[funct].x(functs[funct].arg, &fa);
+  } else {
+    functs[funct].legacy(functs[funct].arg, period);
+  }
+}
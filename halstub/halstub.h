@@ -0,0 +1,60 @@
+/********************************************************************
+* Description:  halstub.h
+*               A userspace stand-in for the HAL and RTAPI, enough to
+*               load one component into an ordinary process, set its
+*               parameters, create instances, poke its pins and call
+*               its functions. Used by the benchmarks in bench/.
+*
+*               Build a component against it by putting this directory
+*               first on the include path and linking halstub.c.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#ifndef HALSTUB_H
+#define HALSTUB_H
+
+#include "hal.h"
+
+// Sets a module or instance parameter from a name=value string, as given
+// to halcmd loadrt or newinst. Returns -1 if there's no such parameter.
+int halstub_set_param(const char *assignment);
+
+// Creates an instance of an instantiable component, as halcmd newinst
+// would. argv holds any arguments that follow -- in newinst.
+int halstub_newinst(const char *name, int argc, char **argv);
+
+// Returns true if the component called hal_xinit.
+bool halstub_instantiable(void);
+
+// Name the component passed to hal_init or hal_xinit.
+const char *halstub_component_name(void);
+
+int halstub_num_pins(void);
+const char *halstub_pin_name(int pin);
+hal_type_t halstub_pin_type(int pin);
+hal_pin_dir_t halstub_pin_dir(int pin);
+void *halstub_pin_ptr(int pin);
+
+// Returns a pointer to the pin's value, or NULL if there's no such pin.
+void *halstub_pin(const char *name);
+
+int halstub_num_functs(void);
+const char *halstub_funct_name(int funct);
+
+// Calls the funct as a thread with the given period would.
+void halstub_run(int funct, long period);
+
+// Messages below this level are not printed. Defaults to RTAPI_MSG_ERR.
+void halstub_set_msg_level(msg_level_t level);
+
+// Frees everything allocated by the components and forgets their pins and
+// functs, so they can be loaded again from a clean state. Parameters keep
+// their values.
+void halstub_reset(void);
+
+#endif
@@ -0,0 +1,54 @@
+/********************************************************************
+* Description:  rtapi.h
+*               Userspace stand-in for the parts of the RTAPI used by
+*               the components in this repository, so they can be
+*               built and exercised without Machinekit. See halstub.h.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#ifndef HALSTUB_RTAPI_H
+#define HALSTUB_RTAPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef enum {
+  RTAPI_MSG_NONE = 0,
+  RTAPI_MSG_ERR,
+  RTAPI_MSG_WARN,
+  RTAPI_MSG_INFO,
+  RTAPI_MSG_DBG,
+  RTAPI_MSG_ALL
+} msg_level_t;
+
+void rtapi_print_msg(msg_level_t level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define rtapi_snprintf snprintf
+#define rtapi_vsnprintf vsnprintf
+
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+
+// Module and instance parameters register themselves before main runs so
+// they can be set by name with halstub_set_param.
+void halstub_register_int(const char *name, int *value);
+void halstub_register_string(const char *name, char **value);
+
+#define HALSTUB_PARAM(var, kind) \
+  static void __attribute__((constructor)) halstub_param_##var(void) { \
+    halstub_register_##kind(#var, &var); \
+  }
+
+#define RTAPI_MP_INT(var, desc) HALSTUB_PARAM(var, int)
+#define RTAPI_MP_STRING(var, desc) HALSTUB_PARAM(var, string)
+#define RTAPI_IP_INT(var, desc) HALSTUB_PARAM(var, int)
+#define RTAPI_IP_STRING(var, desc) HALSTUB_PARAM(var, string)
+
+#endif
@@ -0,0 +1,18 @@
+/********************************************************************
+* Description:  rtapi_app.h
+*               Userspace stand-in, see halstub.h.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#ifndef HALSTUB_RTAPI_APP_H
+#define HALSTUB_RTAPI_APP_H
+
+int rtapi_app_main(void);
+void rtapi_app_exit(void);
+
+#endif
@@ -0,0 +1,17 @@
+/********************************************************************
+* Description:  rtapi_errno.h
+*               Userspace stand-in, see halstub.h.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#ifndef HALSTUB_RTAPI_ERRNO_H
+#define HALSTUB_RTAPI_ERRNO_H
+
+#include <errno.h>
+
+#endif
@@ -0,0 +1,24 @@
+/********************************************************************
+* Description:  rtapi_math.h
+*               Userspace stand-in, see halstub.h.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#ifndef HALSTUB_RTAPI_MATH_H
+#define HALSTUB_RTAPI_MATH_H
+
+#include <math.h>
+
+#define rtapi_sin sin
+#define rtapi_cos cos
+#define rtapi_sqrt sqrt
+#define rtapi_fabs fabs
+#define rtapi_atan2 atan2
+#define rtapi_floor floor
+
+#endif
@@ -21,11 +21,20 @@
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <limits.h>
 
 MODULE_AUTHOR("John Allwine");
 MODULE_DESCRIPTION("Measure pulses from a High Flow LT flow sensor to calculate a flow rate.");
 MODULE_LICENSE("GPL");
 
+// Ratio applied to mode-threshold when switching between period and
+// count modes so a pulse rate sitting right at the threshold doesn't
+// flip the mode every pulse.
+#define MODE_HYSTERESIS 1.25
+
+#define MAX_NUM_INTERVALS 100
+#define MAX_NUM_CHANNELS 16
+
 typedef struct {
   hal_bit_t last_signal;
   hal_bit_t *signal;
@@ -34,75 +43,331 @@ typedef struct {
   hal_float_t *time_window;
   hal_float_t *time;
   hal_u32_t *pulses;
+
+  // Below mode_threshold pulses per second, flow is calculated from the
+  // time between consecutive rising edges rather than by counting pulses
+  // over time_window, which only yields a handful of pulses at low flow.
+  hal_float_t *mode_threshold;
+  hal_bit_t *period_mode;
+
+  // All time keeping is done in integer nanoseconds so long windows don't
+  // accumulate floating point rounding error.
+  long long sinceEdge;    // time since the last rising edge
+  long long edgeInterval; // time between the last two rising edges, 0 if unknown
+  long long windowTime;   // sum of intervalTime, mirrored to the time pin in seconds
+
+  // Values derived from input pins, only recalculated when the pins change.
+  hal_float_t lastPulsesPerLiter;
+  hal_float_t lastTimeWindow;
+  hal_float_t lastModeThreshold;
+  hal_float_t lastAlarmDelay;
+  hal_float_t lastNoFlowTimeout;
+  hal_float_t flowScale;        // 60/pulses_per_liter in L/min per pulse per nanosecond
+  long long timeWindowNs;
+  long long intervalLengthNs;
+  long long countModeInterval;  // switch to count mode below this edge interval
+  long long periodModeInterval; // switch to period mode above this edge interval
+  hal_float_t volumeScale;      // 1/pulses_per_liter
+  long long alarmDelayNs;
+  long long noFlowTimeoutNs;
+
+  // Sliding window of pulse counts. time_window is split into numIntervals
+  // sub-intervals held in a ring. The slot at interval is the one
+  // currently accumulating; when it fills, the oldest slot is dropped
+  // from the running totals (time and pulses pins) and reused.
+  int numIntervals;
+  int interval;
+  hal_u32_t *intervalPulses;
+  long long *intervalTime;
+
+  // Totalizer, volume is totalPulses converted to liters.
+  unsigned long long totalPulses;
+  hal_float_t *volume;
+  hal_bit_t *reset_volume;
+
+  // Coolant interlock. While coolant_on is high, low_flow asserts once the
+  // flow rate has been below alarm_threshold for alarm_delay seconds and
+  // no_flow asserts once no pulse has been seen for no_flow_timeout seconds.
+  hal_bit_t *coolant_on;
+  hal_float_t *alarm_threshold;
+  hal_float_t *alarm_delay;
+  hal_float_t *no_flow_timeout;
+  hal_bit_t *low_flow;
+  hal_bit_t *no_flow;
+  hal_bit_t *alarm;
+  long long coolantOnTime;
+  long long lowFlowTime;
+} channel_t;
+
+// An instance handles one or more flow sensors in a single funct. Each
+// sensor is a channel with its own pins and state.
+typedef struct {
+  int numChannels;
+  channel_t *channels;
 } data_t;
 
 static const char *modname = "high-flow-lt";
 static int comp_id;
 
-static int update(void *arg, const hal_funct_args_t *fa) {
-  data_t *data = (data_t*)arg;
-  long period_ns = fa_period(fa);
-  hal_float_t period_s = (hal_float_t)(period_ns)/1000/1000/1000;
+static int intervals = 10;
+RTAPI_IP_INT(intervals, "number of sub-intervals the sliding time window is divided into");
+
+static int channels = 1;
+RTAPI_IP_INT(channels, "number of flow sensors handled by the instance");
+
+static void update_derived_values(channel_t *data) {
+  if(*(data->pulses_per_liter) != data->lastPulsesPerLiter) {
+    data->lastPulsesPerLiter = *(data->pulses_per_liter);
+    data->flowScale = data->lastPulsesPerLiter > 0 ? 60*1e9/data->lastPulsesPerLiter : 0;
+    data->volumeScale = data->lastPulsesPerLiter > 0 ? 1/data->lastPulsesPerLiter : 0;
+  }
 
-  *(data->time) += period_s;
+  if(*(data->time_window) != data->lastTimeWindow) {
+    data->lastTimeWindow = *(data->time_window);
+    data->timeWindowNs = (long long)(data->lastTimeWindow*1e9);
+    data->intervalLengthNs = data->timeWindowNs/data->numIntervals;
+  }
+
+  if(*(data->mode_threshold) != data->lastModeThreshold) {
+    data->lastModeThreshold = *(data->mode_threshold);
+    if(data->lastModeThreshold > 0) {
+      data->countModeInterval = (long long)(1e9/(data->lastModeThreshold*MODE_HYSTERESIS));
+      data->periodModeInterval = (long long)(1e9*MODE_HYSTERESIS/data->lastModeThreshold);
+    } else {
+      // never use period mode
+      data->countModeInterval = LLONG_MAX;
+      data->periodModeInterval = LLONG_MAX;
+    }
+  }
+
+  if(*(data->alarm_delay) != data->lastAlarmDelay) {
+    data->lastAlarmDelay = *(data->alarm_delay);
+    data->alarmDelayNs = (long long)(data->lastAlarmDelay*1e9);
+  }
+
+  if(*(data->no_flow_timeout) != data->lastNoFlowTimeout) {
+    data->lastNoFlowTimeout = *(data->no_flow_timeout);
+    data->noFlowTimeoutNs = (long long)(data->lastNoFlowTimeout*1e9);
+  }
+}
+
+static void update_channel(channel_t *data, long period_ns) {
+  update_derived_values(data);
+
+  const int interval = data->interval;
+  data->windowTime += period_ns;
+  data->intervalTime[interval] += period_ns;
+  data->sinceEdge += period_ns;
 
   if(!data->last_signal && *(data->signal)) {
     // signal transitioned from low to high
     *(data->pulses) += 1;
+    data->intervalPulses[interval] += 1;
+    data->totalPulses += 1;
+
+    if(data->sinceEdge <= data->timeWindowNs) {
+      data->edgeInterval = data->sinceEdge;
+    }
+    data->sinceEdge = 0;
+  }
+
+  if(data->sinceEdge > data->timeWindowNs) {
+    // no pulses for a whole window, any previous interval is stale
+    data->edgeInterval = 0;
+  }
+
+  if(*(data->period_mode)) {
+    if(data->edgeInterval > 0 && data->edgeInterval < data->countModeInterval) {
+      *(data->period_mode) = 0;
+    }
+  } else if(data->periodModeInterval != LLONG_MAX &&
+            (data->edgeInterval == 0 || data->edgeInterval > data->periodModeInterval)) {
+    *(data->period_mode) = 1;
   }
 
-  if(*(data->time) > *(data->time_window)) {
-    *(data->flow_rate) = *(data->pulses)/(*(data->time))/(*(data->pulses_per_liter))*60;
-    *(data->pulses) = 0;
-    *(data->time) = 0;
+  if(data->intervalTime[interval] >= data->intervalLengthNs) {
+    // current sub-interval is full, drop the oldest one from the window
+    // and start accumulating into its slot
+    int next = interval+1;
+    if(next == data->numIntervals) {
+      next = 0;
+    }
+    *(data->pulses) -= data->intervalPulses[next];
+    data->windowTime -= data->intervalTime[next];
+    data->intervalPulses[next] = 0;
+    data->intervalTime[next] = 0;
+    data->interval = next;
   }
 
+  *(data->time) = data->windowTime*1e-9;
+
+  if(!*(data->period_mode)) {
+    if(data->windowTime > 0) {
+      *(data->flow_rate) = *(data->pulses)*data->flowScale/data->windowTime;
+    }
+  } else {
+    if(data->edgeInterval > 0) {
+      // If the next pulse is overdue, the flow rate is at most one pulse
+      // over the time since the last edge, so decay toward zero instead
+      // of holding the last interval.
+      const long long elapsed = data->sinceEdge > data->edgeInterval ? data->sinceEdge : data->edgeInterval;
+      *(data->flow_rate) = data->flowScale/elapsed;
+    } else {
+      *(data->flow_rate) = 0;
+    }
+  }
+
+  if(*(data->reset_volume)) {
+    data->totalPulses = 0;
+    *(data->reset_volume) = 0;
+  }
+  *(data->volume) = data->totalPulses*data->volumeScale;
+
+  if(*(data->coolant_on)) {
+    data->coolantOnTime += period_ns;
+    if(*(data->flow_rate) < *(data->alarm_threshold)) {
+      data->lowFlowTime += period_ns;
+    } else {
+      data->lowFlowTime = 0;
+    }
+
+    *(data->low_flow) = data->lowFlowTime > data->alarmDelayNs;
+
+    // pulses seen before coolant was turned on don't count toward the timeout
+    const long long noPulseTime = data->sinceEdge < data->coolantOnTime ? data->sinceEdge : data->coolantOnTime;
+    *(data->no_flow) = noPulseTime > data->noFlowTimeoutNs;
+  } else {
+    data->coolantOnTime = 0;
+    data->lowFlowTime = 0;
+    *(data->low_flow) = 0;
+    *(data->no_flow) = 0;
+  }
+  *(data->alarm) = *(data->low_flow) || *(data->no_flow);
+
   data->last_signal = *(data->signal);
+}
+
+static int update(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+  long period_ns = fa_period(fa);
+
+  for(int i = 0; i < data->numChannels; i++) {
+    update_channel(&(data->channels[i]), period_ns);
+  }
+  return 0;
 };
 
-static int instantiate_instance(const int argc, char* const *argv) {
-  data_t *data;
-  const char* instname = argv[1];
+static int export_channel(channel_t *data, int inst_id, const char *prefix, hal_u32_t *intervalPulses, long long *intervalTime) {
   int r;
 
-  int inst_id = hal_inst_create(instname, comp_id, sizeof(data_t), (void**)&data);
-  if(inst_id < 0) {
-    return -1;
+  data->numIntervals = intervals;
+  data->interval = 0;
+  data->intervalPulses = intervalPulses;
+  data->intervalTime = intervalTime;
+  for(int i = 0; i < intervals; i++) {
+    data->intervalPulses[i] = 0;
+    data->intervalTime[i] = 0;
   }
 
-  r = hal_pin_bit_newf(HAL_IN, &(data->signal), inst_id, "%s.signal", instname);
+  r = hal_pin_bit_newf(HAL_IN, &(data->signal), inst_id, "%s.signal", prefix);
   if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.signal'\n", modname, instname);
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.signal'\n", modname, prefix);
     return r;
   }
 
-  r = hal_pin_float_newf(HAL_IN, &(data->pulses_per_liter), inst_id, "%s.pulses-per-liter", instname);
+  r = hal_pin_float_newf(HAL_IN, &(data->pulses_per_liter), inst_id, "%s.pulses-per-liter", prefix);
   if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.pulses-per-liter'\n", modname, instname);
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.pulses-per-liter'\n", modname, prefix);
     return r;
   }
 
-  r = hal_pin_float_newf(HAL_IN, &(data->time_window), inst_id, "%s.time-window", instname);
+  r = hal_pin_float_newf(HAL_IN, &(data->time_window), inst_id, "%s.time-window", prefix);
   if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.time-window'\n", modname, instname);
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.time-window'\n", modname, prefix);
     return r;
   }
 
-  r = hal_pin_float_newf(HAL_OUT, &(data->flow_rate), inst_id, "%s.flow-rate", instname);
+  r = hal_pin_float_newf(HAL_IN, &(data->mode_threshold), inst_id, "%s.mode-threshold", prefix);
   if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.flow-rate'\n", modname, instname);
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.mode-threshold'\n", modname, prefix);
     return r;
   }
 
-  r = hal_pin_float_newf(HAL_OUT, &(data->time), inst_id, "%s.time", instname);
+  r = hal_pin_float_newf(HAL_OUT, &(data->flow_rate), inst_id, "%s.flow-rate", prefix);
   if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.time'\n", modname, instname);
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.flow-rate'\n", modname, prefix);
     return r;
   }
 
-  r = hal_pin_u32_newf(HAL_OUT, &(data->pulses), inst_id, "%s.pulses", instname);
+  r = hal_pin_float_newf(HAL_OUT, &(data->time), inst_id, "%s.time", prefix);
   if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.pulses'\n", modname, instname);
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.time'\n", modname, prefix);
+    return r;
+  }
+
+  r = hal_pin_u32_newf(HAL_OUT, &(data->pulses), inst_id, "%s.pulses", prefix);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.pulses'\n", modname, prefix);
+    return r;
+  }
+
+  r = hal_pin_bit_newf(HAL_OUT, &(data->period_mode), inst_id, "%s.period-mode", prefix);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.period-mode'\n", modname, prefix);
+    return r;
+  }
+
+  r = hal_pin_float_newf(HAL_OUT, &(data->volume), inst_id, "%s.volume", prefix);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.volume'\n", modname, prefix);
+    return r;
+  }
+
+  r = hal_pin_bit_newf(HAL_IO, &(data->reset_volume), inst_id, "%s.reset-volume", prefix);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.reset-volume'\n", modname, prefix);
+    return r;
+  }
+
+  r = hal_pin_bit_newf(HAL_IN, &(data->coolant_on), inst_id, "%s.coolant-on", prefix);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.coolant-on'\n", modname, prefix);
+    return r;
+  }
+
+  r = hal_pin_float_newf(HAL_IN, &(data->alarm_threshold), inst_id, "%s.alarm-threshold", prefix);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.alarm-threshold'\n", modname, prefix);
+    return r;
+  }
+
+  r = hal_pin_float_newf(HAL_IN, &(data->alarm_delay), inst_id, "%s.alarm-delay", prefix);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.alarm-delay'\n", modname, prefix);
+    return r;
+  }
+
+  r = hal_pin_float_newf(HAL_IN, &(data->no_flow_timeout), inst_id, "%s.no-flow-timeout", prefix);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.no-flow-timeout'\n", modname, prefix);
+    return r;
+  }
+
+  r = hal_pin_bit_newf(HAL_OUT, &(data->low_flow), inst_id, "%s.low-flow", prefix);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.low-flow'\n", modname, prefix);
+    return r;
+  }
+
+  r = hal_pin_bit_newf(HAL_OUT, &(data->no_flow), inst_id, "%s.no-flow", prefix);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.no-flow'\n", modname, prefix);
+    return r;
+  }
+
+  r = hal_pin_bit_newf(HAL_OUT, &(data->alarm), inst_id, "%s.alarm", prefix);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.alarm'\n", modname, prefix);
     return r;
   }
 
@@ -112,6 +377,82 @@ static int instantiate_instance(const int argc, char* const *argv) {
   *(data->flow_rate) = 0;
   *(data->time) = 0;
   *(data->pulses) = 0;
+  *(data->mode_threshold) = 20;
+  *(data->period_mode) = 1;
+  *(data->volume) = 0;
+  *(data->reset_volume) = 0;
+  *(data->coolant_on) = 0;
+  *(data->alarm_threshold) = 0.5;
+  *(data->alarm_delay) = 2;
+  *(data->no_flow_timeout) = 2;
+  *(data->low_flow) = 0;
+  *(data->no_flow) = 0;
+  *(data->alarm) = 0;
+  // no edge seen yet, so the first one only starts timing the next
+  data->sinceEdge = LLONG_MAX/2;
+  data->edgeInterval = 0;
+  data->windowTime = 0;
+  data->totalPulses = 0;
+  data->coolantOnTime = 0;
+  data->lowFlowTime = 0;
+
+  // force derived values to be calculated on the first cycle
+  data->lastPulsesPerLiter = -1;
+  data->lastTimeWindow = -1;
+  data->lastModeThreshold = -1;
+  data->lastAlarmDelay = -1;
+  data->lastNoFlowTimeout = -1;
+
+  return 0;
+}
+
+static int instantiate_instance(const int argc, char* const *argv) {
+  data_t *data;
+  const char* instname = argv[1];
+  int r;
+
+  if(intervals < 1) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': intervals must be greater than or equal to 1\n", modname, instname);
+    return -1;
+  }
+  if(intervals > MAX_NUM_INTERVALS) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': intervals must be less than or equal to %d\n", modname, instname, MAX_NUM_INTERVALS);
+    return -1;
+  }
+  if(channels < 1) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': channels must be greater than or equal to 1\n", modname, instname);
+    return -1;
+  }
+  if(channels > MAX_NUM_CHANNELS) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': channels must be less than or equal to %d\n", modname, instname, MAX_NUM_CHANNELS);
+    return -1;
+  }
+
+  int inst_id = hal_inst_create(instname, comp_id, sizeof(data_t), (void**)&data);
+  if(inst_id < 0) {
+    return -1;
+  }
+
+  data->numChannels = channels;
+  data->channels = hal_malloc(channels*sizeof(channel_t));
+  hal_u32_t *intervalPulses = hal_malloc(channels*intervals*sizeof(hal_u32_t));
+  long long *intervalTime = hal_malloc(channels*intervals*sizeof(long long));
+
+  for(int i = 0; i < channels; i++) {
+    // A single channel keeps the original pin names, otherwise pins are
+    // prefixed with the channel number.
+    char prefix[HAL_NAME_LEN+1];
+    if(channels == 1) {
+      rtapi_snprintf(prefix, sizeof(prefix), "%s", instname);
+    } else {
+      rtapi_snprintf(prefix, sizeof(prefix), "%s.%d", instname, i);
+    }
+
+    r = export_channel(&(data->channels[i]), inst_id, prefix, intervalPulses+i*intervals, intervalTime+i*intervals);
+    if(r < 0) {
+      return r;
+    }
+  }
 
   hal_export_xfunct_args_t updateArgs = {
     .type = FS_XTHREADFUNC,
@@ -0,0 +1,349 @@
+/********************************************************************
+* Description:  logic-expr
+* An instantiable component that evaluates a boolean expression over
+* named input pins, such as (a & b) | (!c & d). The expression is
+* compiled once when the instance is created into a small stack
+* program that is run each cycle.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#include "rtapi.h"              /* RTAPI realtime OS API */
+#include "rtapi_app.h"          /* RTAPI realtime module decls */
+#include "rtapi_errno.h"        /* EINVAL etc */
+#include "hal.h"                /* HAL public API decls */
+#include "hal_priv.h"
+#include <sys/mman.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+
+#define MAX_NUM_INPUTS 64
+#define MAX_PROGRAM_LENGTH 256
+#define MAX_EXPRESSION_LENGTH 256
+#define MAX_NAME_LENGTH 32
+
+// The evaluation stack is kept as bits of a 64 bit word, with the top of
+// the stack in the lowest bit.
+#define MAX_STACK_DEPTH 64
+
+MODULE_AUTHOR("John Allwine");
+MODULE_DESCRIPTION("Evaluate a boolean expression of input pins.");
+MODULE_LICENSE("GPL");
+
+typedef enum {
+  OP_INPUT,   // push the input at arg
+  OP_CONST,   // push arg
+  OP_NOT,
+  OP_AND,
+  OP_OR,
+  OP_XOR
+} op_t;
+
+typedef struct {
+  unsigned char op;
+  unsigned char arg;
+} instruction_t;
+
+typedef struct {
+  hal_bit_t **inputs;
+  hal_bit_t *output;
+  int numInputs;
+  instruction_t *program;
+  int programLength;
+} data_t;
+
+// State used while compiling an expression. Only used at instantiation.
+typedef struct {
+  const char *expression;
+  int pos;
+  int error;
+  char names[MAX_NUM_INPUTS][MAX_NAME_LENGTH];
+  int numNames;
+  instruction_t program[MAX_PROGRAM_LENGTH];
+  int length;
+  int depth;
+  int maxDepth;
+} compiler_t;
+
+static const char *modname = "logic-expr";
+static int comp_id;
+
+static int update(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+
+  uint64_t inputs = 0;
+  for(int i = 0; i < data->numInputs; i++) {
+    inputs |= (uint64_t)(*(data->inputs[i]) != 0) << i;
+  }
+
+  uint64_t stack = 0;
+  for(int i = 0; i < data->programLength; i++) {
+    const instruction_t in = data->program[i];
+    uint64_t top;
+    switch(in.op) {
+      case OP_INPUT:
+        stack = (stack << 1) | ((inputs >> in.arg) & 1);
+        break;
+      case OP_CONST:
+        stack = (stack << 1) | in.arg;
+        break;
+      case OP_NOT:
+        stack ^= 1;
+        break;
+      case OP_AND:
+        top = stack & 1;
+        stack >>= 1;
+        stack &= ~(uint64_t)1 | top;
+        break;
+      case OP_OR:
+        top = stack & 1;
+        stack >>= 1;
+        stack |= top;
+        break;
+      case OP_XOR:
+        top = stack & 1;
+        stack >>= 1;
+        stack ^= top;
+        break;
+    }
+  }
+
+  *(data->output) = stack & 1;
+  return 0;
+};
+
+static void emit(compiler_t *c, op_t op, int arg, int depthChange) {
+  if(c->length >= MAX_PROGRAM_LENGTH) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: expression is too long, limit is %d operations\n", modname, MAX_PROGRAM_LENGTH);
+    c->error = 1;
+    return;
+  }
+  c->program[c->length].op = op;
+  c->program[c->length].arg = arg;
+  c->length++;
+
+  c->depth += depthChange;
+  if(c->depth > c->maxDepth) {
+    c->maxDepth = c->depth;
+  }
+}
+
+static void skip_whitespace(compiler_t *c) {
+  while(c->expression[c->pos] == ' ' || c->expression[c->pos] == '\t') {
+    c->pos++;
+  }
+}
+
+static int is_name_start(char ch) {
+  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+static int is_name_char(char ch) {
+  return is_name_start(ch) || (ch >= '0' && ch <= '9') || ch == '-';
+}
+
+static void parse_or(compiler_t *c);
+
+// unary := ('!' | '~') unary | '(' or ')' | '0' | '1' | name
+static void parse_unary(compiler_t *c) {
+  skip_whitespace(c);
+  const char ch = c->expression[c->pos];
+
+  if(ch == '!' || ch == '~') {
+    c->pos++;
+    parse_unary(c);
+    emit(c, OP_NOT, 0, 0);
+  } else if(ch == '(') {
+    c->pos++;
+    parse_or(c);
+    skip_whitespace(c);
+    if(c->expression[c->pos] != ')') {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: expected ')' at position %d\n", modname, c->pos);
+      c->error = 1;
+      return;
+    }
+    c->pos++;
+  } else if(ch == '0' || ch == '1') {
+    c->pos++;
+    emit(c, OP_CONST, ch == '1', 1);
+  } else if(is_name_start(ch)) {
+    char name[MAX_NAME_LENGTH];
+    int len = 0;
+    while(is_name_char(c->expression[c->pos])) {
+      if(len >= MAX_NAME_LENGTH-1) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "%s: input name at position %d is too long\n", modname, c->pos);
+        c->error = 1;
+        return;
+      }
+      name[len++] = c->expression[c->pos++];
+    }
+    name[len] = 0;
+
+    if(strcmp(name, "out") == 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: 'out' is reserved for the output pin\n", modname);
+      c->error = 1;
+      return;
+    }
+
+    int index = 0;
+    while(index < c->numNames && strcmp(c->names[index], name) != 0) {
+      index++;
+    }
+    if(index == c->numNames) {
+      if(c->numNames >= MAX_NUM_INPUTS) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "%s: too many inputs, limit is %d\n", modname, MAX_NUM_INPUTS);
+        c->error = 1;
+        return;
+      }
+      strcpy(c->names[c->numNames++], name);
+    }
+    emit(c, OP_INPUT, index, 1);
+  } else {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: unexpected '%c' at position %d\n", modname, ch ? ch : ' ', c->pos);
+    c->error = 1;
+  }
+}
+
+// Binary operators are parsed with the usual C precedence: & binds tighter
+// than ^, which binds tighter than |. Doubled && and || are also accepted.
+static void parse_binary(compiler_t *c, char symbol, op_t op, void (*operand)(compiler_t*)) {
+  operand(c);
+  while(!c->error) {
+    skip_whitespace(c);
+    if(c->expression[c->pos] != symbol) {
+      break;
+    }
+    c->pos++;
+    if(c->expression[c->pos] == symbol && symbol != '^') {
+      c->pos++;
+    }
+    operand(c);
+    emit(c, op, 0, -1);
+  }
+}
+
+static void parse_and(compiler_t *c) {
+  parse_binary(c, '&', OP_AND, parse_unary);
+}
+
+static void parse_xor(compiler_t *c) {
+  parse_binary(c, '^', OP_XOR, parse_and);
+}
+
+static void parse_or(compiler_t *c) {
+  parse_binary(c, '|', OP_OR, parse_xor);
+}
+
+static int compile(compiler_t *c, const char *expression) {
+  memset(c, 0, sizeof(compiler_t));
+  c->expression = expression;
+
+  parse_or(c);
+  skip_whitespace(c);
+  if(!c->error && c->expression[c->pos] != 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: unexpected '%c' at position %d\n", modname, c->expression[c->pos], c->pos);
+    c->error = 1;
+  }
+  if(!c->error && c->maxDepth > MAX_STACK_DEPTH) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: expression is nested too deeply\n", modname);
+    c->error = 1;
+  }
+  return c->error ? -1 : 0;
+}
+
+static int instantiate(const int argc, char* const *argv) {
+  data_t *data;
+  const char* instname = argv[1];
+  int r;
+
+  if(argc < 3) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': add an expression using -- to separate it from other parameters: newinst %s <name> -- <expression>\n", modname, instname, modname);
+    return -1;
+  }
+
+  // halcmd may split an unquoted expression into several arguments
+  char expression[MAX_EXPRESSION_LENGTH];
+  expression[0] = 0;
+  for(int i = 2; i < argc; i++) {
+    if(strlen(expression)+strlen(argv[i])+2 > sizeof(expression)) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': expression is longer than %d characters\n", modname, instname, MAX_EXPRESSION_LENGTH-1);
+      return -1;
+    }
+    if(i > 2) {
+      strcat(expression, " ");
+    }
+    strcat(expression, argv[i]);
+  }
+
+  // the compiler state is large, so keep it off the stack
+  static compiler_t compiler;
+  if(compile(&compiler, expression) < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': could not compile '%s'\n", modname, instname, expression);
+    return -1;
+  }
+
+  int inst_id = hal_inst_create(instname, comp_id, sizeof(data_t), (void**)&data);
+  if(inst_id < 0) {
+    return -1;
+  }
+
+  data->numInputs = compiler.numNames;
+  data->inputs = hal_malloc(MAX_NUM_INPUTS*sizeof(hal_bit_t *));
+  data->programLength = compiler.length;
+  data->program = hal_malloc(compiler.length*sizeof(instruction_t));
+  memcpy(data->program, compiler.program, compiler.length*sizeof(instruction_t));
+
+  for(int i = 0; i < data->numInputs; i++) {
+    r = hal_pin_bit_newf(HAL_IN, &(data->inputs[i]), inst_id, "%s.%s", instname, compiler.names[i]);
+    if(r < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.%s'\n", modname, instname, compiler.names[i]);
+      return r;
+    }
+    *(data->inputs[i]) = 0;
+  }
+
+  r = hal_pin_bit_newf(HAL_OUT, &(data->output), inst_id, "%s.out", instname);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.out'\n", modname, instname);
+    return r;
+  }
+  *(data->output) = 0;
+
+  hal_export_xfunct_args_t updateArgs = {
+    .type = FS_XTHREADFUNC,
+    .funct.x = update,
+    .arg = data,
+    .uses_fp = 0,
+    .reentrant = 0,
+    .owner_id = inst_id
+  };
+  r = hal_export_xfunctf(&updateArgs, "%s.funct", instname);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: function export failed: %s\n", modname, instname);
+    return r;
+  }
+
+  return 0;
+}
+
+int rtapi_app_main(void) {
+  comp_id = hal_xinit(TYPE_RT, 0, 0, instantiate, NULL, modname);
+  if(comp_id < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: hal_init() failed\n", modname);
+    return -1;
+  }
+
+  hal_ready(comp_id);
+  return 0;
+}
+
+void rtapi_app_exit(void) {
+  hal_exit(comp_id);
+}
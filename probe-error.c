@@ -2,6 +2,18 @@
 * Description:  probe-error
 *               Component that takes in the motion state and error
 *               state of the probe in order to report an error.
+*               Also debounces the probe error input and measures
+*               the latency from the probe tripping to motion
+*               acknowledging it, and from an abort to motion
+*               stopping. A probe-ready output reports whether the
+*               probe has been free of errors long enough to start
+*               a probing move. Aborts can also be raised by a low
+*               battery, the probe staying deflected too long or the
+*               probe tripping during a move that isn't probing. Each
+*               cause is latched separately and reported on the
+*               abort-cause pin. Trips within trip-holdoff seconds
+*               of a probing move ending are ignored, as the stylus
+*               bounces while it re-seats on the retract.
 *
 * Author: John Allwine <john@pocketnc.com>
 * License: GPL Version 2
@@ -19,10 +31,42 @@
 // copied from src/emc/nml_intf/motion_types.h
 #define EMC_MOTION_TYPE_PROBING 5
 
+// Latency measurements that take longer than this are abandoned, as the
+// event they were waiting for is assumed to have been missed.
+#define MAX_LATENCY 1000000000LL
+
+// Error transitions are counted over the last minute in one second
+// buckets.
+#define ERROR_RATE_BUCKETS 60
+#define ERROR_RATE_BUCKET_LENGTH 1000000000LL
+
+// Abort causes, as bits of the latched-causes pin. abort-cause reports the
+// bit index + 1 of the cause of the latest abort, or 0 if there hasn't been
+// one since the last reset.
+#define CAUSE_PROBE_ERROR     0 // probe error while probing
+#define CAUSE_NOT_READY       1 // probing started before probe-ready
+#define CAUSE_LOW_BATTERY     2 // low battery while probing
+#define CAUSE_DEFLECTION      3 // probe-input held longer than overtravel-timeout while probing
+#define CAUSE_UNEXPECTED_TRIP 4 // probe-input rising during a move that isn't probing, after trip-holdoff
+#define NUM_CAUSES 5
+
+#define CAUSE_BIT(cause) (1u << (cause))
+
+// Causes that can abort a probing move and those that can abort any
+// other move.
+#define PROBING_CAUSES (CAUSE_BIT(CAUSE_PROBE_ERROR) | CAUSE_BIT(CAUSE_NOT_READY) | \
+                        CAUSE_BIT(CAUSE_LOW_BATTERY) | CAUSE_BIT(CAUSE_DEFLECTION))
+#define MOVING_CAUSES CAUSE_BIT(CAUSE_UNEXPECTED_TRIP)
+
+// Causes that are single cycle events rather than states. They hold abort
+// until motion stops so the abort can't be missed.
+#define EVENT_CAUSES CAUSE_BIT(CAUSE_UNEXPECTED_TRIP)
+
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <limits.h>
 
 MODULE_AUTHOR("John Allwine");
 MODULE_DESCRIPTION("Report probe error messages when attempting to probe in an error state.");
@@ -38,25 +82,252 @@ MODULE_LICENSE("GPL");
   }
 
 
+// Statistics of a latency measurement, in seconds.
+typedef struct {
+  hal_float_t *last;
+  hal_float_t *min;
+  hal_float_t *max;
+  hal_float_t *mean;
+  hal_u32_t *count;
+  double sum;
+
+  bool timing;       // waiting for the event that ends the measurement
+  long long elapsed; // nanoseconds since the measurement started
+} latency_t;
+
 typedef struct {
   hal_s32_t *motion_type;
   hal_bit_t *probe_error;
   hal_bit_t *probe_on;
   hal_bit_t *abort;
+
+  // probe_error must hold a new state for debounce consecutive cycles
+  // before error follows it.
+  hal_u32_t *debounce;
+  hal_bit_t *error;
+  hal_u32_t errorCycles;
+
+  hal_bit_t *probe_input;   // trip signal from the probe receiver
+  hal_bit_t *probe_tripped; // motion's acknowledgement of the trip
+  hal_bit_t *in_position;   // motion has stopped
+  hal_bit_t *reset_stats;
+
+  latency_t trip;  // probe_input rising to probe_tripped rising
+  latency_t stop;  // abort rising to in_position
+
+  hal_bit_t lastProbeInput;
+  hal_bit_t lastProbeTripped;
+
+  // probe_ready is set once error has been low for ready_hold seconds.
+  // With require_ready set, starting a probing move while the probe
+  // isn't ready also aborts.
+  hal_float_t *ready_hold;
+  hal_bit_t *probe_ready;
+  hal_bit_t *require_ready;
+  hal_float_t lastReadyHold;
+  long long readyHoldNs;
+  long long errorFreeTime;
+
+  // Number of times error went high in the last minute.
+  hal_u32_t *errors_per_minute;
+  hal_u32_t errorBuckets[ERROR_RATE_BUCKETS];
+  int errorBucket;
+  long long errorBucketElapsed;
+  hal_bit_t lastError;
+
+  hal_bit_t *low_battery;
+  hal_float_t *overtravel_timeout; // seconds, 0 disables
+  hal_float_t lastOvertravelTimeout;
+  long long overtravelTimeoutNs;
+  long long trippedTime;
+
+  // Unexpected trips are ignored for trip_holdoff seconds after a probing
+  // move ends.
+  hal_float_t *trip_holdoff;
+  hal_float_t lastTripHoldoff;
+  long long tripHoldoffNs;
+  long long sinceProbing;
+
+  // Each cause sets its bit in latched_causes until reset_abort is set.
+  hal_u32_t *latched_causes;
+  hal_s32_t *abort_cause;
+  hal_float_t *abort_time; // seconds since the component was loaded
+  hal_bit_t *reset_abort;
+  hal_u32_t heldCauses;
+  long long now;
 } data_t;
 
 static data_t *data;
 
+static const char *causeMessages[NUM_CAUSES] = {
+  "Probe is in an error state. Ensure the probe is charged and has line of sight to a receiver.",
+  "Probe has not been free of errors long enough to start probing. Ensure the probe is charged and has line of sight to a receiver.",
+  "Probe battery is low. Charge or replace the probe battery.",
+  "Probe stayed deflected longer than the overtravel timeout while probing.",
+  "Probe tripped during a move that isn't a probing move."
+};
+
 static const char *modname = "probe-error";
 static int comp_id;
 
+static void reset_latency(latency_t *latency) {
+  *(latency->last) = 0;
+  *(latency->min) = 0;
+  *(latency->max) = 0;
+  *(latency->mean) = 0;
+  *(latency->count) = 0;
+  latency->sum = 0;
+  latency->timing = false;
+  latency->elapsed = 0;
+}
+
+static void start_latency(latency_t *latency) {
+  latency->timing = true;
+  latency->elapsed = 0;
+}
+
+// Advances a running measurement and, if done is true, adds it to the
+// statistics.
+static void update_latency(latency_t *latency, bool done, long period) {
+  if(!latency->timing) {
+    return;
+  }
+
+  if(done) {
+    const double t = latency->elapsed*1e-9;
+    const hal_u32_t count = *(latency->count)+1;
+    *(latency->last) = t;
+    if(count == 1 || t < *(latency->min)) {
+      *(latency->min) = t;
+    }
+    if(count == 1 || t > *(latency->max)) {
+      *(latency->max) = t;
+    }
+    latency->sum += t;
+    *(latency->count) = count;
+    *(latency->mean) = latency->sum/count;
+    latency->timing = false;
+  } else {
+    latency->elapsed += period;
+    if(latency->elapsed > MAX_LATENCY) {
+      latency->timing = false;
+    }
+  }
+}
+
 static void update(void *arg, long period) {
+  if(*(data->reset_stats)) {
+    reset_latency(&(data->trip));
+    reset_latency(&(data->stop));
+    *(data->reset_stats) = 0;
+  }
+
+  if(*(data->probe_error) != *(data->error)) {
+    data->errorCycles++;
+    if(data->errorCycles >= *(data->debounce)) {
+      *(data->error) = *(data->probe_error);
+      data->errorCycles = 0;
+    }
+  } else {
+    data->errorCycles = 0;
+  }
+
+  if(*(data->ready_hold) != data->lastReadyHold) {
+    data->lastReadyHold = *(data->ready_hold);
+    data->readyHoldNs = (long long)(data->lastReadyHold*1e9);
+  }
+
+  if(*(data->error)) {
+    data->errorFreeTime = 0;
+  } else if(data->errorFreeTime < data->readyHoldNs) {
+    data->errorFreeTime += period;
+  }
+  *(data->probe_ready) = !*(data->error) && data->errorFreeTime >= data->readyHoldNs;
+
+  data->errorBucketElapsed += period;
+  if(data->errorBucketElapsed >= ERROR_RATE_BUCKET_LENGTH) {
+    // drop the oldest bucket from the count and reuse it
+    data->errorBucketElapsed -= ERROR_RATE_BUCKET_LENGTH;
+    data->errorBucket = (data->errorBucket+1) % ERROR_RATE_BUCKETS;
+    *(data->errors_per_minute) -= data->errorBuckets[data->errorBucket];
+    data->errorBuckets[data->errorBucket] = 0;
+  }
+  if(*(data->error) && !data->lastError) {
+    data->errorBuckets[data->errorBucket]++;
+    *(data->errors_per_minute) += 1;
+  }
+  data->lastError = *(data->error);
+
+  const hal_bit_t probeInput = *(data->probe_input);
+  const hal_bit_t probeTripped = *(data->probe_tripped);
+  if(probeInput && !data->lastProbeInput) {
+    start_latency(&(data->trip));
+  }
+  update_latency(&(data->trip), probeTripped && !data->lastProbeTripped, period);
+  const hal_bit_t lastProbeInput = data->lastProbeInput;
+  data->lastProbeInput = probeInput;
+  data->lastProbeTripped = probeTripped;
+
+  data->now += period;
+  if(*(data->reset_abort)) {
+    *(data->latched_causes) = 0;
+    *(data->abort_cause) = 0;
+    *(data->abort_time) = 0;
+    *(data->reset_abort) = 0;
+  }
+
+  if(*(data->overtravel_timeout) != data->lastOvertravelTimeout) {
+    data->lastOvertravelTimeout = *(data->overtravel_timeout);
+    data->overtravelTimeoutNs = (long long)(data->lastOvertravelTimeout*1e9);
+  }
+  if(probeInput) {
+    data->trippedTime += period;
+  } else {
+    data->trippedTime = 0;
+  }
+
+  const hal_bit_t probing = *(data->motion_type) == EMC_MOTION_TYPE_PROBING;
+  const hal_bit_t moving = *(data->motion_type) != 0;
+
+  if(*(data->trip_holdoff) != data->lastTripHoldoff) {
+    data->lastTripHoldoff = *(data->trip_holdoff);
+    data->tripHoldoffNs = (long long)(data->lastTripHoldoff*1e9);
+  }
+  if(probing) {
+    data->sinceProbing = 0;
+  } else if(data->sinceProbing <= data->tripHoldoffNs) {
+    data->sinceProbing += period;
+  }
+  const hal_bit_t unexpectedTrip = probeInput && !lastProbeInput && data->sinceProbing > data->tripHoldoffNs;
+  const hal_u32_t conditions =
+    ((hal_u32_t)(*(data->error) != 0) << CAUSE_PROBE_ERROR) |
+    ((hal_u32_t)(*(data->require_ready) && !*(data->probe_ready)) << CAUSE_NOT_READY) |
+    ((hal_u32_t)(*(data->low_battery) != 0) << CAUSE_LOW_BATTERY) |
+    ((hal_u32_t)(data->overtravelTimeoutNs > 0 && data->trippedTime > data->overtravelTimeoutNs) << CAUSE_DEFLECTION) |
+    ((hal_u32_t)unexpectedTrip << CAUSE_UNEXPECTED_TRIP);
+  const hal_u32_t gate = !*(data->probe_on) ? 0 :
+                         probing ? PROBING_CAUSES :
+                         moving ? MOVING_CAUSES : 0;
+
+  hal_u32_t causes = conditions & gate;
+  data->heldCauses = moving ? (data->heldCauses | (causes & EVENT_CAUSES)) : 0;
+  causes |= data->heldCauses;
+  *(data->latched_causes) |= causes;
+
   hal_bit_t lastAbort = *(data->abort);
-  *(data->abort) = *(data->probe_on) && *(data->motion_type) == EMC_MOTION_TYPE_PROBING && *(data->probe_error);
+  *(data->abort) = causes != 0;
+
+  if(!lastAbort && *(data->abort)) {
+    start_latency(&(data->stop));
+  }
+  update_latency(&(data->stop), *(data->in_position), period);
 
   if(!lastAbort && *(data->abort)) {
     // only send error on transition into abort state
-    rtapi_print_msg(RTAPI_MSG_ERR, "Probe is in an error state. Ensure the probe is charged and has line of sight to a receiver.");
+    const int cause = __builtin_ctz(causes);
+    *(data->abort_cause) = cause+1;
+    *(data->abort_time) = data->now*1e-9;
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s", causeMessages[cause]);
   }
 }
 
@@ -75,14 +346,88 @@ int rtapi_app_main(void) {
   PIN(bit, HAL_IN, probe_on, probe-on);
   PIN(bit, HAL_OUT, abort, abort);
 
+  PIN(u32, HAL_IN, debounce, debounce);
+  PIN(bit, HAL_OUT, error, error);
+
+  PIN(bit, HAL_IN, probe_input, probe-input);
+  PIN(bit, HAL_IN, probe_tripped, probe-tripped);
+  PIN(bit, HAL_IN, in_position, in-position);
+  PIN(bit, HAL_IO, reset_stats, reset-stats);
+
+  PIN(float, HAL_OUT, trip.last, trip-latency);
+  PIN(float, HAL_OUT, trip.min, trip-latency-min);
+  PIN(float, HAL_OUT, trip.max, trip-latency-max);
+  PIN(float, HAL_OUT, trip.mean, trip-latency-mean);
+  PIN(u32, HAL_OUT, trip.count, trip-count);
+
+  PIN(float, HAL_IN, ready_hold, ready-hold);
+  PIN(bit, HAL_OUT, probe_ready, probe-ready);
+  PIN(bit, HAL_IN, require_ready, require-ready);
+  PIN(u32, HAL_OUT, errors_per_minute, errors-per-minute);
+
+  PIN(float, HAL_OUT, stop.last, stop-latency);
+  PIN(float, HAL_OUT, stop.min, stop-latency-min);
+  PIN(float, HAL_OUT, stop.max, stop-latency-max);
+  PIN(float, HAL_OUT, stop.mean, stop-latency-mean);
+  PIN(u32, HAL_OUT, stop.count, stop-count);
+
+  PIN(bit, HAL_IN, low_battery, low-battery);
+  PIN(float, HAL_IN, overtravel_timeout, overtravel-timeout);
+  PIN(u32, HAL_OUT, latched_causes, latched-causes);
+  PIN(s32, HAL_OUT, abort_cause, abort-cause);
+  PIN(float, HAL_OUT, abort_time, abort-time);
+  PIN(bit, HAL_IO, reset_abort, reset-abort);
+  PIN(float, HAL_IN, trip_holdoff, trip-holdoff);
+
   *(data->motion_type) = 0;
   *(data->probe_error) = 0;
   *(data->probe_on) = 0;
   *(data->abort) = 0;
+  *(data->debounce) = 0;
+  *(data->error) = 0;
+  *(data->probe_input) = 0;
+  *(data->probe_tripped) = 0;
+  *(data->in_position) = 0;
+  *(data->reset_stats) = 0;
+  data->errorCycles = 0;
+  data->lastProbeInput = 0;
+  data->lastProbeTripped = 0;
+  reset_latency(&(data->trip));
+  reset_latency(&(data->stop));
+
+  *(data->ready_hold) = .5;
+  *(data->probe_ready) = 0;
+  *(data->require_ready) = 0;
+  *(data->errors_per_minute) = 0;
+  data->lastReadyHold = -1;
+  data->errorFreeTime = 0;
+  data->errorBucket = 0;
+  data->errorBucketElapsed = 0;
+  data->lastError = 0;
+  for(int i = 0; i < ERROR_RATE_BUCKETS; i++) {
+    data->errorBuckets[i] = 0;
+  }
+
+  *(data->low_battery) = 0;
+  *(data->overtravel_timeout) = 0;
+  *(data->latched_causes) = 0;
+  *(data->abort_cause) = 0;
+  *(data->abort_time) = 0;
+  *(data->reset_abort) = 0;
+  data->lastOvertravelTimeout = -1;
+  data->overtravelTimeoutNs = 0;
+  data->trippedTime = 0;
+  *(data->trip_holdoff) = .5;
+  data->lastTripHoldoff = -1;
+  data->tripHoldoffNs = 0;
+  // no probing move has ended yet, so no holdoff at start up
+  data->sinceProbing = LLONG_MAX/2;
+  data->heldCauses = 0;
+  data->now = 0;
 
   char name[20];
   rtapi_snprintf(name, sizeof(name), "%s.funct", modname);
-  retval = hal_export_funct(name, update, NULL, 0, 0, comp_id);
+  retval = hal_export_funct(name, update, NULL, 1, 0, comp_id);
   if(retval < 0) {
     rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: exporting funct failed", modname);
     hal_exit(comp_id);
@@ -2,7 +2,8 @@
 * Description:  reset-pin
 * A HAL component for resetting the in pin to the value pin after a
 * specific amount of time after detecting a different value on
-* the in pin.
+* the in pin. A single instance can handle multiple pins of type
+* bit, s32, u32 or float.
 *
 * Author: John Allwine <john@pocketnc.com>
 * License: GPL Version 2
@@ -23,90 +24,237 @@
 #include <string.h>
 #include <fcntl.h>
 
+#define MAX_NUM_CHANNELS 64
+
 MODULE_AUTHOR("John Allwine");
 MODULE_DESCRIPTION("Reset the input pin after a specific amount of time.");
 MODULE_LICENSE("GPL");
 
+// Timing shared by every channel type. Elapsed time is accumulated in
+// nanoseconds so threads faster than 1 kHz, or with periods that aren't
+// a whole number of milliseconds, are timed correctly. The delay is
+// delay milliseconds plus delay-us microseconds.
+typedef struct {
+  hal_u32_t *time;     // milliseconds
+  hal_u32_t *delay;    // milliseconds
+  hal_u32_t *delay_us; // microseconds
+
+  long long elapsed;
+  hal_u32_t lastDelay;
+  hal_u32_t lastDelayUs;
+  long long delayNs;
+} reset_timer_t;
+
+// Declares a channel type with in, out and value pins of the given HAL type.
+#define CHANNEL_TYPE(name, halType) \
+  typedef struct { \
+    halType *in; \
+    halType *out; \
+    halType *value; \
+    reset_timer_t timer; \
+  } name##_channel_t;
+
+CHANNEL_TYPE(bit, hal_bit_t)
+CHANNEL_TYPE(s32, hal_s32_t)
+CHANNEL_TYPE(u32, hal_u32_t)
+CHANNEL_TYPE(float, hal_float_t)
+
+// Channels are grouped by type into contiguous arrays so each type is
+// evaluated in its own tight loop.
 typedef struct {
-  hal_bit_t *in;
-  hal_bit_t *out;
-  hal_bit_t *value;
-  hal_u32_t *time;
-  hal_u32_t *delay;
+  int numBit;
+  int numS32;
+  int numU32;
+  int numFloat;
+  bit_channel_t *bitChannels;
+  s32_channel_t *s32Channels;
+  u32_channel_t *u32Channels;
+  float_channel_t *floatChannels;
 } reset_pin_data_t;
 
 static const char *modname = "reset-pin";
 static int comp_id;
 
-static int update(void *arg, const hal_funct_args_t *fa) {
-  reset_pin_data_t *data = (reset_pin_data_t*)arg;
-  long period_ns = fa_period(fa);
-  hal_u32_t period_ms = (hal_u32_t)(period_ns/1000/1000);
+static char *types = "b";
+RTAPI_IP_STRING(types, "type of each channel, one character per channel: b (bit), s (s32), u (u32) or f (float). Default: b.");
+
+// Advances the timer of a channel whose in pin doesn't match value and
+// returns whether the delay has elapsed. Resets the timer when they match.
+static inline int timer_expired(reset_timer_t *timer, int matches, long period_ns) {
+  if(*(timer->delay) != timer->lastDelay || *(timer->delay_us) != timer->lastDelayUs) {
+    timer->lastDelay = *(timer->delay);
+    timer->lastDelayUs = *(timer->delay_us);
+    timer->delayNs = timer->lastDelay*1000000LL+timer->lastDelayUs*1000LL;
+  }
 
-  if(*(data->in) == *(data->value)) {
-    *(data->time) = 0;
+  int expired = 0;
+  if(matches) {
+    timer->elapsed = 0;
   } else {
-    *(data->time) += period_ms;
+    timer->elapsed += period_ns;
+    expired = timer->elapsed > timer->delayNs;
+  }
 
-    if(*(data->time) > *(data->delay)) {
-      *(data->in) = *(data->value);
-    }
+  *(timer->time) = (hal_u32_t)(timer->elapsed/1000000);
+  return expired;
+}
+
+#define UPDATE_CHANNELS(channels, count, period_ns) \
+  for(int i = 0; i < (count); i++) { \
+    if(timer_expired(&(channels)[i].timer, *((channels)[i].in) == *((channels)[i].value), (period_ns))) { \
+      *((channels)[i].in) = *((channels)[i].value); \
+    } \
+    *((channels)[i].out) = *((channels)[i].in); \
   }
 
-  *(data->out) = *(data->in);
+static int update(void *arg, const hal_funct_args_t *fa) {
+  reset_pin_data_t *data = (reset_pin_data_t*)arg;
+  long period_ns = fa_period(fa);
+
+  UPDATE_CHANNELS(data->bitChannels, data->numBit, period_ns);
+  UPDATE_CHANNELS(data->s32Channels, data->numS32, period_ns);
+  UPDATE_CHANNELS(data->u32Channels, data->numU32, period_ns);
+  UPDATE_CHANNELS(data->floatChannels, data->numFloat, period_ns);
+  return 0;
 };
 
-static int instantiate_reset_pin(const int argc, char* const *argv) {
-  reset_pin_data_t *data;
-  const char* instname = argv[1];
+static int export_timer(reset_timer_t *timer, int inst_id, const char *prefix) {
   int r;
 
-  int inst_id = hal_inst_create(instname, comp_id, sizeof(reset_pin_data_t), (void**)&data);
-  if(inst_id < 0) {
-    return -1;
-  }
-
-  r = hal_pin_bit_newf(HAL_IO, &(data->in), inst_id, "%s.in", instname);
+  r = hal_pin_u32_newf(HAL_IN, &(timer->delay), inst_id, "%s.delay", prefix);
   if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.in'\n", modname, instname);
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.delay'\n", modname, prefix);
     return r;
   }
 
-  r = hal_pin_bit_newf(HAL_IN, &(data->value), inst_id, "%s.value", instname);
+  r = hal_pin_u32_newf(HAL_IN, &(timer->delay_us), inst_id, "%s.delay-us", prefix);
   if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.value'\n", modname, instname);
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.delay-us'\n", modname, prefix);
     return r;
   }
 
-  r = hal_pin_u32_newf(HAL_IN, &(data->delay), inst_id, "%s.delay", instname);
+  r = hal_pin_u32_newf(HAL_OUT, &(timer->time), inst_id, "%s.time", prefix);
   if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.delay'\n", modname, instname);
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.time'\n", modname, prefix);
     return r;
   }
 
-  r = hal_pin_bit_newf(HAL_OUT, &(data->out), inst_id, "%s.out", instname);
-  if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.out'\n", modname, instname);
-    return r;
+  *(timer->time) = 0;
+  *(timer->delay) = 100;
+  *(timer->delay_us) = 0;
+  timer->elapsed = 0;
+  timer->lastDelay = -1;
+  timer->lastDelayUs = -1;
+  return 0;
+}
+
+// Defines export_<name>_channel, which creates the in, value and out pins
+// of a channel along with its timer pins.
+#define EXPORT_CHANNEL(name) \
+  static int export_##name##_channel(name##_channel_t *channel, int inst_id, const char *prefix) { \
+    int r; \
+    r = hal_pin_##name##_newf(HAL_IO, &(channel->in), inst_id, "%s.in", prefix); \
+    if(r < 0) { \
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.in'\n", modname, prefix); \
+      return r; \
+    } \
+    r = hal_pin_##name##_newf(HAL_IN, &(channel->value), inst_id, "%s.value", prefix); \
+    if(r < 0) { \
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.value'\n", modname, prefix); \
+      return r; \
+    } \
+    r = hal_pin_##name##_newf(HAL_OUT, &(channel->out), inst_id, "%s.out", prefix); \
+    if(r < 0) { \
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.out'\n", modname, prefix); \
+      return r; \
+    } \
+    *(channel->in) = 0; \
+    *(channel->out) = 0; \
+    *(channel->value) = 0; \
+    return export_timer(&(channel->timer), inst_id, prefix); \
   }
 
-  r = hal_pin_u32_newf(HAL_OUT, &(data->time), inst_id, "%s.time", instname);
-  if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.time'\n", modname, instname);
-    return r;
+EXPORT_CHANNEL(bit)
+EXPORT_CHANNEL(s32)
+EXPORT_CHANNEL(u32)
+EXPORT_CHANNEL(float)
+
+static int instantiate_reset_pin(const int argc, char* const *argv) {
+  reset_pin_data_t *data;
+  const char* instname = argv[1];
+  int r;
+
+  const int numChannels = strlen(types);
+  if(numChannels < 1) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': types must contain at least one channel\n", modname, instname);
+    return -1;
+  }
+  if(numChannels > MAX_NUM_CHANNELS) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': types must contain at most %d channels\n", modname, instname, MAX_NUM_CHANNELS);
+    return -1;
   }
 
-  *(data->in) = 0;
-  *(data->out) = 0;
-  *(data->value) = 0;
-  *(data->time) = 0;
-  *(data->delay) = 100;
+  int numBit = 0, numS32 = 0, numU32 = 0, numFloat = 0;
+  for(int i = 0; i < numChannels; i++) {
+    switch(types[i]) {
+      case 'b': numBit++; break;
+      case 's': numS32++; break;
+      case 'u': numU32++; break;
+      case 'f': numFloat++; break;
+      default:
+        rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': unknown channel type '%c'\n", modname, instname, types[i]);
+        return -1;
+    }
+  }
+
+  int inst_id = hal_inst_create(instname, comp_id, sizeof(reset_pin_data_t), (void**)&data);
+  if(inst_id < 0) {
+    return -1;
+  }
+
+  data->bitChannels = numBit ? hal_malloc(numBit*sizeof(bit_channel_t)) : NULL;
+  data->s32Channels = numS32 ? hal_malloc(numS32*sizeof(s32_channel_t)) : NULL;
+  data->u32Channels = numU32 ? hal_malloc(numU32*sizeof(u32_channel_t)) : NULL;
+  data->floatChannels = numFloat ? hal_malloc(numFloat*sizeof(float_channel_t)) : NULL;
+  data->numBit = 0;
+  data->numS32 = 0;
+  data->numU32 = 0;
+  data->numFloat = 0;
+
+  for(int i = 0; i < numChannels; i++) {
+    // A single channel keeps the original pin names, otherwise pins are
+    // prefixed with the channel number.
+    char prefix[HAL_NAME_LEN+1];
+    if(numChannels == 1) {
+      rtapi_snprintf(prefix, sizeof(prefix), "%s", instname);
+    } else {
+      rtapi_snprintf(prefix, sizeof(prefix), "%s.%d", instname, i);
+    }
+
+    switch(types[i]) {
+      case 'b':
+        r = export_bit_channel(&(data->bitChannels[data->numBit++]), inst_id, prefix);
+        break;
+      case 's':
+        r = export_s32_channel(&(data->s32Channels[data->numS32++]), inst_id, prefix);
+        break;
+      case 'u':
+        r = export_u32_channel(&(data->u32Channels[data->numU32++]), inst_id, prefix);
+        break;
+      default:
+        r = export_float_channel(&(data->floatChannels[data->numFloat++]), inst_id, prefix);
+        break;
+    }
+    if(r < 0) {
+      return r;
+    }
+  }
 
   hal_export_xfunct_args_t updateArgs = {
     .type = FS_XTHREADFUNC,
     .funct.x = update,
     .arg = data,
-    .uses_fp = 0,
+    .uses_fp = numFloat > 0, // float channels compare and copy doubles
     .reentrant = 0,
     .owner_id = inst_id
   };
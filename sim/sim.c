@@ -0,0 +1,747 @@
+/********************************************************************
+* Description:  sim.c
+*               Fault injection simulator for solo-estop and torque.
+*               Both components are loaded into one process against
+*               the userspace HAL stand-in in halstub/ and wired up as
+*               they are on the machine, along with simple models of
+*               the ClearPath motors, the E-Stop relay, the spindle VFD
+*               and iocontrol/halui.
+*
+*               Scenarios are either scripts of timed events and
+*               expectations, or generated randomly. Every scenario is
+*               also checked against invariants that must always hold.
+*               Scenarios are spread across worker processes, one per
+*               core by default.
+*
+*               Usage: sim [-j workers] [-r count] [-s seed] [-l cycles] [-v] [-t] [script ...]
+*
+*               -v prints the components' messages and -t prints every
+*               change of the output pins.
+*
+*               Each cycle is one servo period, 1ms. Script lines are
+*               <cycle>[-<end cycle>] <command> [args], with # comments,
+*               in any order:
+*                 button <0|1>        press or release the E-Stop button
+*                 reset               click E-Stop reset in the UI
+*                 fault <axis>        motor faults until it's disabled
+*                 ferror <axis> <0|1> following error on a joint
+*                 torque <axis> <t>   motor torque, -1 to 1
+*                 vfd <code>          spindle VFD error code, 0 for none
+*                 modbus <0|1>        spindle modbus connection is ok
+*                 ignore-com <0|1>    ignore-com-errors pin
+*                 expect <pin> <0|1>  solo-estop output pin has the value
+*                                     on the cycle, or every cycle in the
+*                                     range
+*                 end                 last cycle of the scenario
+*
+*               A failing random scenario is printed as a script so it
+*               can be replayed.
+*
+* Author: John Allwine <john@pocketnc.com>
+* License: GPL Version 2
+*
+* Copyright (c) 2024 Pocket NC Company All rights reserved.
+*
+********************************************************************/
+
+#include "halstub.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// The components are built with their rtapi_app_main renamed so they can
+// be linked together.
+int torque_app_main(void);
+int solo_estop_app_main(void);
+
+#define AXES "xyzbct"
+#define NUM_AXES 6
+
+// ClearPath motors are configured for 482Hz PWM feedback.
+#define PWM_FREQUENCY 482
+
+#define DEFAULT_RANDOM_LENGTH 10000
+#define MAX_LINE_LENGTH 256
+#define MAX_MESSAGE_LENGTH 256
+
+typedef enum {
+  EVENT_BUTTON,
+  EVENT_RESET,
+  EVENT_FAULT,
+  EVENT_FERROR,
+  EVENT_TORQUE,
+  EVENT_VFD,
+  EVENT_MODBUS,
+  EVENT_IGNORE_COM,
+  EVENT_EXPECT,
+  EVENT_END
+} event_type_t;
+
+static const char *eventNames[] = {
+  "button",
+  "reset",
+  "fault",
+  "ferror",
+  "torque",
+  "vfd",
+  "modbus",
+  "ignore-com",
+  "expect",
+  "end"
+};
+
+// solo-estop outputs that can be checked with expect
+static const char *outputNames[] = {
+  "emc-enable",
+  "power",
+  "machine-on",
+  "user-requested-enable",
+  "unhome",
+  "x-motor-enable",
+  "y-motor-enable",
+  "z-motor-enable",
+  "b-motor-enable",
+  "c-motor-enable",
+  "t-motor-enable"
+};
+#define NUM_OUTPUTS (sizeof(outputNames)/sizeof(outputNames[0]))
+#define OUTPUT_EMC_ENABLE 0
+#define OUTPUT_POWER 1
+#define OUTPUT_MACHINE_ON 2
+#define OUTPUT_USER_REQUESTED_ENABLE 3
+#define OUTPUT_MOTOR_ENABLE 5
+
+typedef struct {
+  long start;
+  long end;       // last cycle of an expect range
+  event_type_t type;
+  int index;      // axis or output
+  double value;
+} event_t;
+
+typedef struct {
+  char name[MAX_LINE_LENGTH];
+  event_t *events; // sorted by start
+  int numEvents;
+  int capacity;
+  long length;
+} scenario_t;
+
+typedef struct {
+  // torque pins
+  hal_float_t *dutyCycle[NUM_AXES];
+  hal_float_t *frequency[NUM_AXES];
+  hal_bit_t *torqueFault[NUM_AXES];
+
+  // solo-estop pins
+  hal_bit_t *fault[NUM_AXES];
+  hal_bit_t *ferror[NUM_AXES];
+  hal_bit_t *button;
+  hal_s32_t *spindleErrorCode;
+  hal_bit_t *spindleModbusOk;
+  hal_bit_t *ignoreComErrors;
+  hal_bit_t *userRequestEnable;
+  hal_bit_t *userEnable;
+  hal_bit_t *outputs[NUM_OUTPUTS];
+
+  int torqueFunct;
+  int estopFunct;
+
+  // simulated machine
+  bool buttonPressed;
+  bool motorFaulted[NUM_AXES];
+  bool followingError[NUM_AXES];
+  double torque[NUM_AXES];
+  int vfdCode;
+  bool modbusOk;
+  bool ignoreCom;
+  bool resetClicked;
+  bool userEnabled;           // iocontrol.0.user-enable-out
+  bool last[NUM_OUTPUTS];
+} sim_t;
+
+typedef struct {
+  long scenarios;
+  long failures;
+} results_t;
+
+static bool verbose = false;
+static bool trace = false;
+
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static long random_range(uint64_t *state, long min, long max) {
+  return min+(long)(next_random(state) % (uint64_t)(max-min+1));
+}
+
+static void add_event(scenario_t *scenario, event_t event) {
+  if(scenario->numEvents == scenario->capacity) {
+    scenario->capacity = scenario->capacity ? scenario->capacity*2 : 16;
+    scenario->events = realloc(scenario->events, scenario->capacity*sizeof(event_t));
+  }
+  scenario->events[scenario->numEvents++] = event;
+  if(event.end+1 > scenario->length) {
+    scenario->length = event.end+1;
+  }
+}
+
+// Insertion sort by start, which keeps events on the same cycle in the
+// order they were added. Scenarios only have tens of events.
+static void sort_events(scenario_t *scenario) {
+  for(int i = 1; i < scenario->numEvents; i++) {
+    const event_t e = scenario->events[i];
+    int j = i;
+    while(j > 0 && scenario->events[j-1].start > e.start) {
+      scenario->events[j] = scenario->events[j-1];
+      j--;
+    }
+    scenario->events[j] = e;
+  }
+}
+
+static void print_scenario(FILE *out, const scenario_t *scenario) {
+  fprintf(out, "# %s\n", scenario->name);
+  for(int i = 0; i < scenario->numEvents; i++) {
+    const event_t *e = &scenario->events[i];
+    fprintf(out, "%ld", e->start);
+    if(e->end != e->start) {
+      fprintf(out, "-%ld", e->end);
+    }
+    fprintf(out, " %s", eventNames[e->type]);
+    switch(e->type) {
+      case EVENT_FAULT:
+        fprintf(out, " %c", AXES[e->index]);
+        break;
+      case EVENT_FERROR:
+        fprintf(out, " %c %d", AXES[e->index], (int)e->value);
+        break;
+      case EVENT_TORQUE:
+        fprintf(out, " %c %g", AXES[e->index], e->value);
+        break;
+      case EVENT_EXPECT:
+        fprintf(out, " %s %d", outputNames[e->index], (int)e->value);
+        break;
+      case EVENT_BUTTON:
+      case EVENT_VFD:
+      case EVENT_MODBUS:
+      case EVENT_IGNORE_COM:
+        fprintf(out, " %d", (int)e->value);
+        break;
+      default:
+        break;
+    }
+    fprintf(out, "\n");
+  }
+}
+
+static int axis_index(const char *axis) {
+  const char *found = axis[0] && !axis[1] ? strchr(AXES, axis[0]) : NULL;
+  return found ? found-AXES : -1;
+}
+
+static int output_index(const char *name) {
+  for(unsigned int i = 0; i < NUM_OUTPUTS; i++) {
+    if(strcmp(outputNames[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int parse_script(const char *path, scenario_t *scenario) {
+  FILE *f = fopen(path, "r");
+  if(!f) {
+    fprintf(stderr, "sim: could not open %s\n", path);
+    return -1;
+  }
+
+  memset(scenario, 0, sizeof(scenario_t));
+  snprintf(scenario->name, sizeof(scenario->name), "%s", path);
+
+  char line[MAX_LINE_LENGTH];
+  int lineNumber = 0;
+  int r = 0;
+  while(r == 0 && fgets(line, sizeof(line), f)) {
+    lineNumber++;
+    char *comment = strchr(line, '#');
+    if(comment) {
+      *comment = 0;
+    }
+
+    char cycles[64], command[64], arg1[64], arg2[64];
+    const int n = sscanf(line, "%63s %63s %63s %63s", cycles, command, arg1, arg2);
+    if(n <= 0) {
+      continue;
+    }
+
+    event_t e = { 0 };
+    char *rest;
+    e.start = strtol(cycles, &rest, 10);
+    e.end = *rest == '-' ? strtol(rest+1, &rest, 10) : e.start;
+    e.type = EVENT_END+1;
+    for(int i = 0; i <= EVENT_END; i++) {
+      if(n >= 2 && strcmp(command, eventNames[i]) == 0) {
+        e.type = i;
+      }
+    }
+
+    bool ok = *rest == 0 && e.start >= 0 && e.end >= e.start && e.type <= EVENT_END;
+    if(ok) {
+      switch(e.type) {
+        case EVENT_FAULT:
+          e.index = n == 3 ? axis_index(arg1) : -1;
+          ok = e.index >= 0;
+          break;
+        case EVENT_FERROR:
+        case EVENT_TORQUE:
+          e.index = n == 4 ? axis_index(arg1) : -1;
+          e.value = n == 4 ? atof(arg2) : 0;
+          ok = e.index >= 0;
+          break;
+        case EVENT_EXPECT:
+          e.index = n == 4 ? output_index(arg1) : -1;
+          e.value = n == 4 ? atoi(arg2) : 0;
+          ok = e.index >= 0;
+          break;
+        case EVENT_BUTTON:
+        case EVENT_VFD:
+        case EVENT_MODBUS:
+        case EVENT_IGNORE_COM:
+          e.value = n == 3 ? atoi(arg1) : 0;
+          ok = n == 3;
+          break;
+        case EVENT_RESET:
+        case EVENT_END:
+          ok = n == 2;
+          break;
+      }
+      ok = ok && (e.type == EVENT_EXPECT || e.end == e.start);
+    }
+
+    if(!ok) {
+      fprintf(stderr, "%s:%d: invalid line\n", path, lineNumber);
+      r = -1;
+    } else {
+      add_event(scenario, e);
+    }
+  }
+  fclose(f);
+  sort_events(scenario);
+  return r;
+}
+
+// Generates a scenario of random button presses, resets, faults and
+// communication errors. It has no expectations, so only the invariants
+// are checked.
+static void random_scenario(scenario_t *scenario, uint64_t seed, long length) {
+  memset(scenario, 0, sizeof(scenario_t));
+  snprintf(scenario->name, sizeof(scenario->name), "random seed %llu", (unsigned long long)seed);
+
+  uint64_t state = seed*0x9e3779b97f4a7c15ULL+1;
+  const long events = random_range(&state, 1, length/500+1);
+
+  // bring the machine up first, most of the time
+  if(random_range(&state, 0, 3)) {
+    const long start = random_range(&state, 0, 500);
+    add_event(scenario, (event_t){ .start = start, .end = start, .type = EVENT_RESET });
+  }
+
+  for(long i = 0; i < events; i++) {
+    const long start = random_range(&state, 0, length-1);
+    const long duration = random_range(&state, 1, 4000);
+    const long end = start+duration < length ? start+duration : length-1;
+    const int axis = random_range(&state, 0, NUM_AXES-1);
+    switch(random_range(&state, 0, 7)) {
+      case 0:
+        add_event(scenario, (event_t){ .start = start, .end = start, .type = EVENT_BUTTON, .value = 1 });
+        add_event(scenario, (event_t){ .start = end, .end = end, .type = EVENT_BUTTON, .value = 0 });
+        break;
+      case 1:
+        add_event(scenario, (event_t){ .start = start, .end = start, .type = EVENT_RESET });
+        break;
+      case 2:
+        add_event(scenario, (event_t){ .start = start, .end = start, .type = EVENT_FAULT, .index = axis });
+        break;
+      case 3: {
+        const long ferrorEnd = start+duration/100 < length ? start+duration/100 : length-1;
+        add_event(scenario, (event_t){ .start = start, .end = start, .type = EVENT_FERROR, .index = axis, .value = 1 });
+        add_event(scenario, (event_t){ .start = ferrorEnd, .end = ferrorEnd, .type = EVENT_FERROR, .index = axis, .value = 0 });
+        break;
+      }
+      case 4:
+        add_event(scenario, (event_t){ .start = start, .end = start, .type = EVENT_VFD, .value = random_range(&state, 1, 20) });
+        add_event(scenario, (event_t){ .start = end, .end = end, .type = EVENT_VFD, .value = 0 });
+        break;
+      case 5:
+        add_event(scenario, (event_t){ .start = start, .end = start, .type = EVENT_MODBUS, .value = 0 });
+        add_event(scenario, (event_t){ .start = end, .end = end, .type = EVENT_MODBUS, .value = 1 });
+        break;
+      case 6:
+        add_event(scenario, (event_t){ .start = start, .end = start, .type = EVENT_IGNORE_COM, .value = 1 });
+        add_event(scenario, (event_t){ .start = end, .end = end, .type = EVENT_IGNORE_COM, .value = 0 });
+        break;
+      case 7:
+        add_event(scenario, (event_t){ .start = start, .end = start, .type = EVENT_TORQUE, .index = axis,
+                                       .value = random_range(&state, -100, 100)/100. });
+        break;
+    }
+  }
+
+  sort_events(scenario);
+  scenario->length = length;
+}
+
+static int load(sim_t *sim) {
+  halstub_reset();
+  if(torque_app_main() < 0 || solo_estop_app_main() < 0) {
+    return -1;
+  }
+  sim->torqueFunct = 0;
+  sim->estopFunct = 1;
+
+  char name[HAL_NAME_LEN+1];
+  for(int i = 0; i < NUM_AXES; i++) {
+    snprintf(name, sizeof(name), "torque.duty_cycle.%c", AXES[i]);
+    sim->dutyCycle[i] = halstub_pin(name);
+    snprintf(name, sizeof(name), "torque.frequency.%c", AXES[i]);
+    sim->frequency[i] = halstub_pin(name);
+    snprintf(name, sizeof(name), "torque.fault.%c", AXES[i]);
+    sim->torqueFault[i] = halstub_pin(name);
+    snprintf(name, sizeof(name), "solo-estop.%c-fault", AXES[i]);
+    sim->fault[i] = halstub_pin(name);
+    snprintf(name, sizeof(name), "solo-estop.%c-f-error", AXES[i]);
+    sim->ferror[i] = halstub_pin(name);
+  }
+  sim->button = halstub_pin("solo-estop.button");
+  sim->spindleErrorCode = halstub_pin("solo-estop.spindle-error-code");
+  sim->spindleModbusOk = halstub_pin("solo-estop.spindle-modbus-ok");
+  sim->ignoreComErrors = halstub_pin("solo-estop.ignore-com-errors");
+  sim->userRequestEnable = halstub_pin("solo-estop.user-request-enable");
+  sim->userEnable = halstub_pin("solo-estop.user-enable");
+  for(unsigned int i = 0; i < NUM_OUTPUTS; i++) {
+    snprintf(name, sizeof(name), "solo-estop.%s", outputNames[i]);
+    sim->outputs[i] = halstub_pin(name);
+    sim->last[i] = *(sim->outputs[i]);
+  }
+
+  sim->buttonPressed = false;
+  sim->vfdCode = 0;
+  sim->modbusOk = true;
+  sim->ignoreCom = false;
+  sim->resetClicked = false;
+  sim->userEnabled = false;
+  for(int i = 0; i < NUM_AXES; i++) {
+    sim->motorFaulted[i] = false;
+    sim->followingError[i] = false;
+    sim->torque[i] = 0;
+  }
+  return 0;
+}
+
+static void apply_event(sim_t *sim, const event_t *e) {
+  switch(e->type) {
+    case EVENT_BUTTON:
+      sim->buttonPressed = e->value != 0;
+      break;
+    case EVENT_RESET:
+      // iocontrol turns user-enable-out on and pulses user-request-enable
+      sim->resetClicked = true;
+      sim->userEnabled = true;
+      break;
+    case EVENT_FAULT:
+      sim->motorFaulted[e->index] = true;
+      break;
+    case EVENT_FERROR:
+      sim->followingError[e->index] = e->value != 0;
+      break;
+    case EVENT_TORQUE:
+      sim->torque[e->index] = e->value;
+      break;
+    case EVENT_VFD:
+      sim->vfdCode = e->value;
+      break;
+    case EVENT_MODBUS:
+      sim->modbusOk = e->value != 0;
+      break;
+    case EVENT_IGNORE_COM:
+      sim->ignoreCom = e->value != 0;
+      break;
+    default:
+      break;
+  }
+}
+
+// Duty cycle that torque converts back to t.
+static double torque_duty_cycle(double t) {
+  return t > 0 ? .05+(1-t)*.45 : .5-t*.45;
+}
+
+// Runs one servo cycle, in the order of the servo thread.
+static void step(sim_t *sim) {
+  // the E-Stop button and power pin drive the same relay
+  const bool powered = *(sim->outputs[OUTPUT_POWER]) && !sim->buttonPressed;
+
+  for(int i = 0; i < NUM_AXES; i++) {
+    // disabling a ClearPath clears its fault, while unpowered or faulted
+    // motors hold their feedback high
+    if(!*(sim->outputs[OUTPUT_MOTOR_ENABLE+i])) {
+      sim->motorFaulted[i] = false;
+    }
+    *(sim->dutyCycle[i]) = !powered || sim->motorFaulted[i] ? 1 : torque_duty_cycle(sim->torque[i]);
+    *(sim->frequency[i]) = PWM_FREQUENCY;
+  }
+
+  halstub_run(sim->torqueFunct, 1000000);
+
+  for(int i = 0; i < NUM_AXES; i++) {
+    *(sim->fault[i]) = *(sim->torqueFault[i]);
+    *(sim->ferror[i]) = sim->followingError[i];
+  }
+  *(sim->button) = sim->buttonPressed;
+  *(sim->spindleErrorCode) = sim->vfdCode;
+  // the VFD is on the same relay, so modbus drops when it's unpowered
+  *(sim->spindleModbusOk) = sim->modbusOk && powered;
+  *(sim->ignoreComErrors) = sim->ignoreCom;
+  *(sim->userRequestEnable) = sim->resetClicked;
+  *(sim->userEnable) = sim->userEnabled;
+
+  halstub_run(sim->estopFunct, 1000000);
+
+  sim->resetClicked = false;
+
+  // EMC stays in E-Stop, with user-enable-out off, while emc-enable-in is
+  // low, unless solo-estop is in the middle of a reset.
+  // user-requested-enable is connected to halui.estop.reset, which turns
+  // it back on.
+  if(!*(sim->outputs[OUTPUT_EMC_ENABLE]) && !*(sim->outputs[OUTPUT_USER_REQUESTED_ENABLE])) {
+    sim->userEnabled = false;
+  }
+  if(!sim->last[OUTPUT_USER_REQUESTED_ENABLE] && *(sim->outputs[OUTPUT_USER_REQUESTED_ENABLE])) {
+    sim->userEnabled = true;
+  }
+}
+
+// Checks the properties that must hold on every cycle. Returns a
+// description of the first one that doesn't, or NULL.
+static const char *check_invariants(const sim_t *sim) {
+  const bool emcEnable = *(sim->outputs[OUTPUT_EMC_ENABLE]);
+
+  if(*(sim->outputs[OUTPUT_MACHINE_ON]) && !emcEnable) {
+    return "machine-on is high while emc-enable is low";
+  }
+  if(sim->buttonPressed && emcEnable) {
+    return "emc-enable is high while the E-Stop button is pressed";
+  }
+  for(int i = 0; i < NUM_AXES; i++) {
+    if(sim->followingError[i] && emcEnable) {
+      return "emc-enable is high during a following error";
+    }
+  }
+  // Power is only cut when the E-Stop comes after the reset sequence has
+  // finished. An E-Stop while user-requested-enable is still high, in the
+  // RESET_TIME after a reset, drops emc-enable but leaves power on.
+  if(sim->last[OUTPUT_EMC_ENABLE] && !emcEnable && !sim->last[OUTPUT_USER_REQUESTED_ENABLE] &&
+     *(sim->outputs[OUTPUT_POWER])) {
+    return "power stayed on when emc-enable went low";
+  }
+  if(!sim->last[OUTPUT_EMC_ENABLE] && emcEnable && !sim->last[OUTPUT_USER_REQUESTED_ENABLE] &&
+     !*(sim->outputs[OUTPUT_USER_REQUESTED_ENABLE])) {
+    return "emc-enable went high without an E-Stop reset";
+  }
+  return NULL;
+}
+
+// Runs a scenario, writing a message to out for the first failure. Returns
+// true if it passed.
+static bool run_scenario(sim_t *sim, const scenario_t *scenario, FILE *out) {
+  if(load(sim) < 0) {
+    fprintf(out, "%s: could not load components\n", scenario->name);
+    return false;
+  }
+
+  int next = 0;
+  for(long cycle = 0; cycle < scenario->length; cycle++) {
+    while(next < scenario->numEvents && scenario->events[next].start == cycle) {
+      apply_event(sim, &scenario->events[next++]);
+    }
+
+    step(sim);
+
+    char message[MAX_MESSAGE_LENGTH];
+    const char *failure = check_invariants(sim);
+    for(int i = 0; !failure && i < next; i++) {
+      const event_t *e = &scenario->events[i];
+      if(e->type == EVENT_EXPECT && cycle <= e->end && *(sim->outputs[e->index]) != (e->value != 0)) {
+        snprintf(message, sizeof(message), "expected %s to be %d", outputNames[e->index], (int)e->value);
+        failure = message;
+      }
+    }
+
+    for(unsigned int i = 0; trace && i < NUM_OUTPUTS; i++) {
+      if(sim->last[i] != *(sim->outputs[i])) {
+        fprintf(out, "%s: cycle %ld: %s %d\n", scenario->name, cycle, outputNames[i], *(sim->outputs[i]));
+      }
+    }
+
+    if(failure) {
+      fprintf(out, "%s: cycle %ld: %s\n", scenario->name, cycle, failure);
+      return false;
+    }
+
+    for(unsigned int i = 0; i < NUM_OUTPUTS; i++) {
+      sim->last[i] = *(sim->outputs[i]);
+    }
+  }
+  return true;
+}
+
+// Runs every workers'th scenario starting at worker. Scripts are run first,
+// followed by the random scenarios.
+static results_t run_worker(int worker, int workers, const scenario_t *scripts, int numScripts, long numRandom, uint64_t seed, long length) {
+  results_t results = { 0, 0 };
+  sim_t sim;
+  scenario_t randomScenario = { 0 };
+
+  for(long i = worker; i < numScripts+numRandom; i += workers) {
+    const scenario_t *scenario;
+    if(i < numScripts) {
+      scenario = &scripts[i];
+    } else {
+      free(randomScenario.events);
+      random_scenario(&randomScenario, seed+(i-numScripts), length);
+      scenario = &randomScenario;
+    }
+
+    // buffer the report so reports from different workers don't interleave
+    char *report = NULL;
+    size_t reportLength = 0;
+    FILE *out = open_memstream(&report, &reportLength);
+    if(!run_scenario(&sim, scenario, out)) {
+      if(i >= numScripts) {
+        print_scenario(out, scenario);
+      }
+      results.failures++;
+    }
+    fclose(out);
+    if(reportLength > 0 && write(STDOUT_FILENO, report, reportLength) < 0) {
+      perror("sim");
+    }
+    free(report);
+    results.scenarios++;
+  }
+
+  free(randomScenario.events);
+  return results;
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: sim [-j workers] [-r count] [-s seed] [-l cycles] [-v] [-t] [script ...]\n");
+}
+
+int main(int argc, char **argv) {
+  long workers = sysconf(_SC_NPROCESSORS_ONLN);
+  long numRandom = 0;
+  uint64_t seed = 1;
+  long length = DEFAULT_RANDOM_LENGTH;
+
+  int opt;
+  while((opt = getopt(argc, argv, "j:r:s:l:vt")) != -1) {
+    switch(opt) {
+      case 'j':
+        workers = strtol(optarg, NULL, 0);
+        break;
+      case 'r':
+        numRandom = strtol(optarg, NULL, 0);
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 0);
+        break;
+      case 'l':
+        length = strtol(optarg, NULL, 0);
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      case 't':
+        trace = true;
+        break;
+      default:
+        usage();
+        return 1;
+    }
+  }
+
+  const int numScripts = argc-optind;
+  if(workers < 1 || numRandom < 0 || length < 1 || numScripts+numRandom == 0) {
+    usage();
+    return 1;
+  }
+
+  scenario_t *scripts = calloc(numScripts ? numScripts : 1, sizeof(scenario_t));
+  for(int i = 0; i < numScripts; i++) {
+    if(parse_script(argv[optind+i], &scripts[i]) < 0) {
+      return 1;
+    }
+  }
+
+  if(workers > numScripts+numRandom) {
+    workers = numScripts+numRandom;
+  }
+
+  halstub_set_param("axes=" AXES);
+  halstub_set_msg_level(verbose ? RTAPI_MSG_ERR : RTAPI_MSG_NONE);
+  setvbuf(stdout, NULL, _IONBF, 0);
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  int results[2];
+  if(pipe(results) < 0) {
+    perror("sim");
+    return 1;
+  }
+
+  for(int worker = 0; worker < workers; worker++) {
+    const pid_t pid = fork();
+    if(pid < 0) {
+      perror("sim");
+      return 1;
+    }
+    if(pid == 0) {
+      close(results[0]);
+      const results_t r = run_worker(worker, workers, scripts, numScripts, numRandom, seed, length);
+      // writes this small are atomic, so workers can share the pipe
+      const int ok = write(results[1], &r, sizeof(r)) == sizeof(r);
+      _exit(ok ? 0 : 1);
+    }
+  }
+  close(results[1]);
+
+  results_t total = { 0, 0 };
+  results_t r;
+  while(read(results[0], &r, sizeof(r)) == sizeof(r)) {
+    total.scenarios += r.scenarios;
+    total.failures += r.failures;
+  }
+
+  bool workerFailed = false;
+  int status;
+  while(wait(&status) > 0) {
+    workerFailed = workerFailed || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  const double elapsed = (end.tv_sec-start.tv_sec)+(end.tv_nsec-start.tv_nsec)*1e-9;
+  printf("%ld scenarios, %ld failed, %.0f scenarios/s on %ld workers\n",
+         total.scenarios, total.failures, total.scenarios/elapsed, workers);
+
+  return total.failures > 0 || workerFailed || total.scenarios != numScripts+numRandom;
+}
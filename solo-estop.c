@@ -208,7 +208,7 @@ static void update(void *arg, long period) {
   const hal_bit_t zFError = *(data->zFError);
   const hal_bit_t bFError = *(data->bFError);
   const hal_bit_t cFError = *(data->cFError);
-  const hal_bit_t tFError = *(data->cFError);
+  const hal_bit_t tFError = *(data->tFError);
 
   const hal_bit_t power = *(data->power);
   const hal_bit_t button = *(data->button);
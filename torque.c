@@ -109,7 +109,7 @@ int rtapi_app_main(void) {
     }
     retval = hal_pin_float_newf(HAL_OUT, &(data[i].torque), comp_id, "%s.%c", modname, axes[i]);
     if(retval < 0) {
-      rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.c", modname, modname, axes[i]);
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: could not create pin %s.%c", modname, modname, axes[i]);
       hal_exit(comp_id);
       return -1;
     }
@@ -3,6 +3,27 @@
 * An instantiable component for sending a message when transitioning
 * an input pin from low to high.
 *
+* The message may contain placeholders for values of input pins that
+* are created along with the instance: %d or %i (s32), %u or %x (u32),
+* %f, %e or %g (float) and %b (bit), with optional flags, width and
+* precision, such as %.2f. When placeholders are used, the funct only
+* captures the pin values into a fixed size record and the print funct
+* formats and sends the message. Add the print funct to a slower thread
+* so no formatting is done in the servo thread.
+*
+* Passing more than one message creates a catalog instance that sends
+* message n on a rising edge of its in<n> pin, or, with the indexed
+* instance parameter set, when the index pin changes to n. Catalog
+* messages can't contain placeholders.
+*
+* Each message is rate limited with a token bucket: after burst messages
+* sent back to back, a message is sent at most once every min-interval
+* milliseconds. Suppressed repeats are counted on the suppressed pin and
+* the next message that gets through reports how many times it was
+* repeated. If no message follows, a summary of the last suppressed one
+* with its repeat count is sent once the limit allows it. A min-interval
+* of 0 disables rate limiting.
+*
 * Author: John Allwine <john@pentamachine.com>
 * License: GPL Version 2
 *    
@@ -33,31 +54,484 @@ MODULE_LICENSE("GPL");
   RTAPI_MSG_DBG = 4
 */
 
+#define MAX_NUM_ARGS 8
+#define MAX_PENDING 8
+#define MAX_MESSAGE_LENGTH 256
+#define MAX_NUM_MESSAGES 256
+
+// Catalog triggers are packed into 64 bit words for edge detection.
+#define WORD_BITS 64
+
+typedef enum {
+  ARG_S32,
+  ARG_U32,
+  ARG_FLOAT,
+  ARG_BIT
+} arg_type_t;
+
+typedef struct {
+  arg_type_t type;
+  union {
+    hal_s32_t *s32;
+    hal_u32_t *u32;
+    hal_float_t *f;
+    hal_bit_t *bit;
+  } pin;
+} arg_t;
+
+// Piece of the message containing literal text followed by at most one
+// placeholder. arg is the index of the placeholder's value or -1.
+typedef struct {
+  char *format;
+  int arg;
+} segment_t;
+
+// Pin values captured when the message was triggered.
+typedef struct {
+  msg_level_t type;
+  unsigned int repeated;
+  union {
+    int s32;
+    unsigned int u32;
+    double f;
+  } values[MAX_NUM_ARGS];
+} record_t;
+
+// Token bucket state of a message. The bucket is refilled lazily when the
+// message is triggered, so checking it is O(1) and untriggered messages
+// cost nothing.
+typedef struct {
+  long long credit;      // nanoseconds of sending allowance
+  long long lastTime;    // time of the last refill
+  unsigned int repeated; // times suppressed since the message was last sent
+  msg_level_t type;      // level of the last suppressed message
+} limiter_t;
+
 typedef struct {
   hal_bit_t *in;
   hal_u32_t *type;
   char *message;
   hal_bit_t lastIn;
+
+  int numArgs;
+  arg_t args[MAX_NUM_ARGS];
+  int numSegments;
+  segment_t *segments;
+
+  // Ring of records waiting to be printed. Written only by the funct and
+  // read only by the print funct, which may run in different threads.
+  record_t pending[MAX_PENDING];
+  unsigned int head;
+  unsigned int tail;
+  hal_u32_t *dropped; // number of messages lost because the ring was full
+
+  // Catalog of messages, used when more than one message is given.
+  int numMessages;
+  hal_bit_t **triggers;
+  uint64_t *lastTriggers;
+  hal_s32_t *index;
+  int lastIndex;
+
+  // Formats of messages without placeholders, with any stray % escaped, and
+  // the same formats followed by a repeat count. Index 0 is used for a
+  // single message.
+  char **formats;
+  char **repeatFormats;
+
+  // Rate limiting, one limiter per message. Limiters with unreported
+  // repeats have their bit set in pendingSummaries, and numPending counts
+  // them so there's nothing to check when none are pending.
+  limiter_t *limiters;
+  uint64_t *pendingSummaries;
+  int numPending;
+  record_t lastSuppressed; // values of the last suppressed message with placeholders
+  hal_u32_t *min_interval; // milliseconds
+  hal_u32_t *burst;
+  hal_u32_t *suppressed;
+  hal_u32_t lastMinInterval;
+  long long intervalNs;
+  long long now;
 } data_t;
 
+static const char *repeatSuffix = " (repeated %u times)";
+
 char* defaultMessage = "This is the default message. Add a message argument using -- to separate it from other parameters: newinst user-message <name> -- <message>";
 
 static const char *modname = "user-message";
 static int comp_id;
 
+static int indexed = 0;
+RTAPI_IP_INT(indexed, "when more than one message is given, select the message with an s32 index pin instead of one trigger pin per message");
+
+static void advance_clock(data_t *data, long period_ns) {
+  data->now += period_ns;
+
+  if(*(data->min_interval) != data->lastMinInterval) {
+    data->lastMinInterval = *(data->min_interval);
+    data->intervalNs = (long long)data->lastMinInterval*1000*1000;
+  }
+}
+
+// Refills the bucket of limiter up to now and returns whether it has
+// enough credit to send a message.
+static int refill(data_t *data, limiter_t *limiter) {
+  if(data->intervalNs <= 0) {
+    return 1;
+  }
+
+  const long long burst = *(data->burst) > 1 ? *(data->burst) : 1;
+  const long long capacity = burst*data->intervalNs;
+
+  long long credit = limiter->credit + (data->now-limiter->lastTime);
+  if(credit > capacity) {
+    credit = capacity;
+  }
+  limiter->lastTime = data->now;
+  limiter->credit = credit;
+  return credit >= data->intervalNs;
+}
+
+// Takes the credit for sending message index and returns how many times it
+// was suppressed since it was last sent, which is now reported.
+static unsigned int take(data_t *data, int index) {
+  limiter_t *limiter = &(data->limiters[index]);
+  if(data->intervalNs > 0) {
+    limiter->credit -= data->intervalNs;
+  }
+
+  const uint64_t bit = (uint64_t)1 << (index % WORD_BITS);
+  if(data->pendingSummaries[index/WORD_BITS] & bit) {
+    data->pendingSummaries[index/WORD_BITS] &= ~bit;
+    data->numPending--;
+  }
+
+  const unsigned int repeated = limiter->repeated;
+  limiter->repeated = 0;
+  return repeated;
+}
+
+// Returns whether message index may be sent now. If so, repeated is set to
+// the number of times it was suppressed since it was last sent.
+static int rate_limit(data_t *data, int index, msg_level_t t, unsigned int *repeated) {
+  limiter_t *limiter = &(data->limiters[index]);
+  if(!refill(data, limiter)) {
+    limiter->repeated++;
+    limiter->type = t;
+    *(data->suppressed) += 1;
+
+    const uint64_t bit = (uint64_t)1 << (index % WORD_BITS);
+    if(!(data->pendingSummaries[index/WORD_BITS] & bit)) {
+      data->pendingSummaries[index/WORD_BITS] |= bit;
+      data->numPending++;
+    }
+    return 0;
+  }
+
+  *repeated = take(data, index);
+  return 1;
+}
+
+static void send_message(data_t *data, int index, msg_level_t t) {
+  unsigned int repeated;
+  if(!rate_limit(data, index, t, &repeated)) {
+    return;
+  }
+
+  if(repeated > 0) {
+    rtapi_print_msg(t, data->repeatFormats[index], repeated);
+  } else {
+    rtapi_print_msg(t, data->formats[index]);
+  }
+}
+
+static void copy_values(data_t *data, record_t *record) {
+  for(int i = 0; i < data->numArgs; i++) {
+    switch(data->args[i].type) {
+      case ARG_S32:
+        record->values[i].s32 = *(data->args[i].pin.s32);
+        break;
+      case ARG_U32:
+        record->values[i].u32 = *(data->args[i].pin.u32);
+        break;
+      case ARG_FLOAT:
+        record->values[i].f = *(data->args[i].pin.f);
+        break;
+      case ARG_BIT:
+        record->values[i].s32 = *(data->args[i].pin.bit);
+        break;
+    }
+  }
+}
+
+// Returns the next free record in the ring, or NULL if it's full.
+static record_t* next_record(data_t *data) {
+  const unsigned int next = (data->head+1) % MAX_PENDING;
+  if(next == __atomic_load_n(&(data->tail), __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &(data->pending[data->head]);
+}
+
+static void push_record(data_t *data) {
+  __atomic_store_n(&(data->head), (data->head+1) % MAX_PENDING, __ATOMIC_RELEASE);
+}
+
+static void capture(data_t *data, msg_level_t t) {
+  record_t *record = next_record(data);
+  if(record == NULL) {
+    *(data->dropped) += 1;
+    return;
+  }
+
+  unsigned int repeated;
+  if(!rate_limit(data, 0, t, &repeated)) {
+    copy_values(data, &(data->lastSuppressed));
+    return;
+  }
+
+  record->type = t;
+  record->repeated = repeated;
+  copy_values(data, record);
+  push_record(data);
+}
+
+// Sends a summary for each limiter with unreported repeats that has enough
+// credit again, so repeats of a message that then stops aren't lost.
+static void flush_summaries(data_t *data) {
+  if(data->numPending == 0) {
+    return;
+  }
+
+  const int numLimiters = data->numMessages > 1 ? data->numMessages : 1;
+  for(int base = 0, w = 0; base < numLimiters; base += WORD_BITS, w++) {
+    uint64_t pending = data->pendingSummaries[w];
+    while(pending) {
+      const int index = base+__builtin_ctzll(pending);
+      pending &= pending-1;
+
+      limiter_t *limiter = &(data->limiters[index]);
+      if(!refill(data, limiter)) {
+        continue;
+      }
+
+      if(data->numArgs > 0) {
+        record_t *record = next_record(data);
+        if(record == NULL) {
+          // try again once print has made room
+          continue;
+        }
+        *record = data->lastSuppressed;
+        record->type = limiter->type;
+        record->repeated = take(data, index);
+        push_record(data);
+      } else {
+        rtapi_print_msg(limiter->type, data->repeatFormats[index], take(data, index));
+      }
+    }
+  }
+}
+
 static int update(void *arg, const hal_funct_args_t *fa) {
   data_t *data = (data_t*)arg;
+  advance_clock(data, fa_period(fa));
+  flush_summaries(data);
 
   if(!data->lastIn && *(data->in)) {
     if(*(data->type) >= 1 && *(data->type) <= 4) {
       msg_level_t t = (msg_level_t)(*(data->type));
-      rtapi_print_msg(t, data->message);
+      if(data->numArgs > 0) {
+        capture(data, t);
+      } else {
+        send_message(data, 0, t);
+      }
     }
   }
 
   data->lastIn = *(data->in);
+  return 0;
 };
 
+static int update_catalog(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+  const hal_u32_t type = *(data->type);
+  advance_clock(data, fa_period(fa));
+  flush_summaries(data);
+
+  for(int base = 0, w = 0; base < data->numMessages; base += WORD_BITS, w++) {
+    const int n = data->numMessages-base < WORD_BITS ? data->numMessages-base : WORD_BITS;
+
+    uint64_t word = 0;
+    for(int i = 0; i < n; i++) {
+      word |= (uint64_t)(*(data->triggers[base+i]) != 0) << i;
+    }
+
+    uint64_t rising = word & ~data->lastTriggers[w];
+    data->lastTriggers[w] = word;
+
+    if(type >= 1 && type <= 4) {
+      while(rising) {
+        send_message(data, base+__builtin_ctzll(rising), (msg_level_t)type);
+        rising &= rising-1;
+      }
+    }
+  }
+  return 0;
+}
+
+static int update_catalog_index(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+  const int index = *(data->index);
+  advance_clock(data, fa_period(fa));
+  flush_summaries(data);
+
+  if(index != data->lastIndex && index >= 0 && index < data->numMessages) {
+    if(*(data->type) >= 1 && *(data->type) <= 4) {
+      send_message(data, index, (msg_level_t)(*(data->type)));
+    }
+  }
+
+  data->lastIndex = index;
+  return 0;
+}
+
+static int print(void *arg, const hal_funct_args_t *fa) {
+  data_t *data = (data_t*)arg;
+
+  unsigned int tail = data->tail;
+  while(tail != __atomic_load_n(&(data->head), __ATOMIC_ACQUIRE)) {
+    const record_t *record = &(data->pending[tail]);
+    char message[MAX_MESSAGE_LENGTH];
+    int len = 0;
+
+    for(int i = 0; i < data->numSegments && len < sizeof(message); i++) {
+      const segment_t *segment = &(data->segments[i]);
+      char *out = message+len;
+      const int size = sizeof(message)-len;
+      int n;
+
+      if(segment->arg < 0) {
+        n = rtapi_snprintf(out, size, segment->format);
+      } else if(data->args[segment->arg].type == ARG_FLOAT) {
+        n = rtapi_snprintf(out, size, segment->format, record->values[segment->arg].f);
+      } else if(data->args[segment->arg].type == ARG_U32) {
+        n = rtapi_snprintf(out, size, segment->format, record->values[segment->arg].u32);
+      } else {
+        n = rtapi_snprintf(out, size, segment->format, record->values[segment->arg].s32);
+      }
+      if(n > 0) {
+        len += n;
+      }
+    }
+
+    if(record->repeated > 0 && len < sizeof(message)) {
+      rtapi_snprintf(message+len, sizeof(message)-len, repeatSuffix, record->repeated);
+    }
+
+    rtapi_print_msg(record->type, "%s", message);
+
+    tail = (tail+1) % MAX_PENDING;
+    __atomic_store_n(&(data->tail), tail, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+// Splits the message into segments with at most one placeholder each and
+// records the pin type needed for each placeholder. Returns the number of
+// segments, or -1 if the message has too many placeholders.
+static int parse_message(const char *message, segment_t *segments, arg_t *args, int *numArgs) {
+  const int length = strlen(message);
+  int numSegments = 0;
+  int start = 0;
+  char *format = NULL;
+  int len = 0;
+
+  *numArgs = 0;
+  for(int i = 0; i <= length; i++) {
+    if(message[i] == 0) {
+      if(format != NULL && len > 0) {
+        format[len] = 0;
+        segments[numSegments].format = format;
+        segments[numSegments].arg = -1;
+        numSegments++;
+      }
+      break;
+    }
+
+    if(format == NULL) {
+      // worst case every character is a % that has to be escaped
+      format = hal_malloc(2*(length-start)+2);
+      len = 0;
+    }
+
+    if(message[i] != '%') {
+      format[len++] = message[i];
+      continue;
+    }
+
+    if(message[i+1] == '%') {
+      format[len++] = '%';
+      format[len++] = '%';
+      i++;
+      continue;
+    }
+
+    // flags, width and precision. The space flag isn't accepted so text
+    // like "50% done" isn't mistaken for a placeholder.
+    int end = i+1;
+    while(message[end] && strchr("-+#0", message[end])) {
+      end++;
+    }
+    while(message[end] >= '0' && message[end] <= '9') {
+      end++;
+    }
+    if(message[end] == '.') {
+      end++;
+      while(message[end] >= '0' && message[end] <= '9') {
+        end++;
+      }
+    }
+
+    arg_type_t type;
+    char conversion = message[end];
+    if(conversion == 'd' || conversion == 'i') {
+      type = ARG_S32;
+    } else if(conversion == 'u' || conversion == 'x' || conversion == 'X') {
+      type = ARG_U32;
+    } else if(conversion && strchr("fFeEgG", conversion)) {
+      type = ARG_FLOAT;
+    } else if(conversion == 'b') {
+      type = ARG_BIT;
+      conversion = 'd';
+    } else {
+      // not a placeholder we support, keep the % as literal text
+      format[len++] = '%';
+      format[len++] = '%';
+      continue;
+    }
+
+    if(*numArgs >= MAX_NUM_ARGS) {
+      return -1;
+    }
+
+    memcpy(format+len, message+i, end-i);
+    len += end-i;
+    format[len++] = conversion;
+    format[len] = 0;
+
+    args[*numArgs].type = type;
+    segments[numSegments].format = format;
+    segments[numSegments].arg = *numArgs;
+    numSegments++;
+    (*numArgs)++;
+
+    format = NULL;
+    start = end+1;
+    i = end;
+  }
+
+  return numSegments;
+}
+
 static int instantiate(const int argc, char* const *argv) {
   data_t *data;
   const char* instname = argv[1];
@@ -73,32 +547,185 @@ static int instantiate(const int argc, char* const *argv) {
     return -1;
   }
 
-  if(argc >= 3) {
-    data->message = argv[2];
+  const int numMessages = argc-2;
+  if(numMessages > MAX_NUM_MESSAGES) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': at most %d messages are supported\n", modname, instname, MAX_NUM_MESSAGES);
+    return -1;
+  }
+
+  hal_xfunct_t update_funct = update;
+  data->numArgs = 0;
+  data->numMessages = 0;
+  if(numMessages > 1) {
+    data->numMessages = numMessages;
+    data->formats = hal_malloc(numMessages*sizeof(char *));
+
+    for(int i = 0; i < numMessages; i++) {
+      segment_t segments[MAX_NUM_ARGS+1];
+      arg_t args[MAX_NUM_ARGS];
+      int numArgs;
+      r = parse_message(argv[i+2], segments, args, &numArgs);
+      if(numArgs > 0 || r < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': message %d has placeholders, which are only supported with a single message\n", modname, instname, i);
+        return -1;
+      }
+      // parsing escapes any % that isn't a placeholder
+      data->formats[i] = r > 0 ? segments[0].format : "";
+    }
+
+    if(indexed) {
+      r = hal_pin_s32_newf(HAL_IN, &(data->index), inst_id, "%s.index", instname);
+      if(r < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.index'\n", modname, instname);
+        return r;
+      }
+      *(data->index) = -1;
+      data->lastIndex = -1;
+      update_funct = update_catalog_index;
+    } else {
+      const int numWords = (numMessages+WORD_BITS-1)/WORD_BITS;
+      data->triggers = hal_malloc(numMessages*sizeof(hal_bit_t *));
+      data->lastTriggers = hal_malloc(numWords*sizeof(uint64_t));
+      for(int w = 0; w < numWords; w++) {
+        data->lastTriggers[w] = 0;
+      }
+
+      for(int i = 0; i < numMessages; i++) {
+        r = hal_pin_bit_newf(HAL_IO, &(data->triggers[i]), inst_id, "%s.in%d", instname, i);
+        if(r < 0) {
+          rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.in%d'\n", modname, instname, i);
+          return r;
+        }
+        *(data->triggers[i]) = 0;
+      }
+      update_funct = update_catalog;
+    }
+
+    r = hal_pin_u32_newf(HAL_IN, &(data->type), inst_id, "%s.type", instname);
+    if(r < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.type'\n", modname, instname);
+      return r;
+    }
+    *(data->type) = 1;
   } else {
-    data->message = defaultMessage;
+    if(argc >= 3) {
+      data->message = argv[2];
+    } else {
+      data->message = defaultMessage;
+    }
+
+    // each placeholder ends a segment, plus the trailing text
+    segment_t segments[MAX_NUM_ARGS+1];
+    data->numSegments = parse_message(data->message, segments, data->args, &(data->numArgs));
+    if(data->numSegments < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error instantiating '%s': message has more than %d placeholders\n", modname, instname, MAX_NUM_ARGS);
+      return -1;
+    }
+    data->segments = hal_malloc((data->numSegments+1)*sizeof(segment_t));
+    memcpy(data->segments, segments, data->numSegments*sizeof(segment_t));
+    data->formats = hal_malloc(sizeof(char *));
+    data->formats[0] = data->numSegments > 0 ? segments[0].format : "";
+    data->head = 0;
+    data->tail = 0;
+
+    for(int i = 0; i < data->numArgs; i++) {
+      switch(data->args[i].type) {
+        case ARG_S32:
+          r = hal_pin_s32_newf(HAL_IN, &(data->args[i].pin.s32), inst_id, "%s.arg%d", instname, i);
+          break;
+        case ARG_U32:
+          r = hal_pin_u32_newf(HAL_IN, &(data->args[i].pin.u32), inst_id, "%s.arg%d", instname, i);
+          break;
+        case ARG_FLOAT:
+          r = hal_pin_float_newf(HAL_IN, &(data->args[i].pin.f), inst_id, "%s.arg%d", instname, i);
+          break;
+        case ARG_BIT:
+          r = hal_pin_bit_newf(HAL_IN, &(data->args[i].pin.bit), inst_id, "%s.arg%d", instname, i);
+          break;
+      }
+      if(r < 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.arg%d'\n", modname, instname, i);
+        return r;
+      }
+    }
+
+    r = hal_pin_u32_newf(HAL_OUT, &(data->dropped), inst_id, "%s.dropped", instname);
+    if(r < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.dropped'\n", modname, instname);
+      return r;
+    }
+    *(data->dropped) = 0;
+
+    r = hal_pin_bit_newf(HAL_IO, &(data->in), inst_id, "%s.in", instname);
+    if(r < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.in'\n", modname, instname);
+      return r;
+    }
+
+    r = hal_pin_u32_newf(HAL_IN, &(data->type), inst_id, "%s.type", instname);
+    if(r < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.type'\n", modname, instname);
+      return r;
+    }
+
+    *(data->in) = 0;
+    *(data->type) = 1;
+  }
+
+  const int numLimiters = numMessages > 1 ? numMessages : 1;
+  data->limiters = hal_malloc(numLimiters*sizeof(limiter_t));
+  data->repeatFormats = hal_malloc(numLimiters*sizeof(char *));
+  const int numPendingWords = (numLimiters+WORD_BITS-1)/WORD_BITS;
+  data->pendingSummaries = hal_malloc(numPendingWords*sizeof(uint64_t));
+  for(int w = 0; w < numPendingWords; w++) {
+    data->pendingSummaries[w] = 0;
   }
+  data->numPending = 0;
+  for(int i = 0; i < numLimiters; i++) {
+    // start with a full bucket
+    data->limiters[i].credit = 0;
+    data->limiters[i].lastTime = -(1LL << 62);
+    data->limiters[i].repeated = 0;
+    data->limiters[i].type = RTAPI_MSG_ERR;
 
-  r = hal_pin_bit_newf(HAL_IO, &(data->in), inst_id, "%s.in", instname);
+    if(data->numArgs == 0) {
+      data->repeatFormats[i] = hal_malloc(strlen(data->formats[i])+strlen(repeatSuffix)+1);
+      strcpy(data->repeatFormats[i], data->formats[i]);
+      strcat(data->repeatFormats[i], repeatSuffix);
+    }
+  }
+  data->now = 0;
+  data->lastMinInterval = 0;
+  data->intervalNs = 0;
+
+  r = hal_pin_u32_newf(HAL_IN, &(data->min_interval), inst_id, "%s.min-interval", instname);
+  if(r < 0) {
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.min-interval'\n", modname, instname);
+    return r;
+  }
+
+  r = hal_pin_u32_newf(HAL_IN, &(data->burst), inst_id, "%s.burst", instname);
   if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.in'\n", modname, instname);
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.burst'\n", modname, instname);
     return r;
   }
 
-  r = hal_pin_u32_newf(HAL_IN, &(data->type), inst_id, "%s.type", instname);
+  r = hal_pin_u32_newf(HAL_OUT, &(data->suppressed), inst_id, "%s.suppressed", instname);
   if(r < 0) {
-    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.type'\n", modname, instname);
+    rtapi_print_msg(RTAPI_MSG_ERR, "%s: Error adding pin '%s.suppressed'\n", modname, instname);
     return r;
   }
 
-  *(data->in) = 0;
-  *(data->type) = 1;
+  *(data->min_interval) = 0;
+  *(data->burst) = 1;
+  *(data->suppressed) = 0;
 
   hal_export_xfunct_args_t updateArgs = {
     .type = FS_XTHREADFUNC,
-    .funct.x = update,
+    .funct.x = update_funct,
     .arg = data,
-    .uses_fp = 0,
+    // gcc copies records and limiter state through SSE registers
+    .uses_fp = 1,
     .reentrant = 0,
     .owner_id = inst_id
   };
@@ -108,6 +735,22 @@ static int instantiate(const int argc, char* const *argv) {
     return r;
   }
 
+  if(data->numArgs > 0) {
+    hal_export_xfunct_args_t printArgs = {
+      .type = FS_XTHREADFUNC,
+      .funct.x = print,
+      .arg = data,
+      .uses_fp = 1,
+      .reentrant = 0,
+      .owner_id = inst_id
+    };
+    r = hal_export_xfunctf(&printArgs, "%s.print", instname);
+    if(r < 0) {
+      rtapi_print_msg(RTAPI_MSG_ERR, "%s: ERROR: function export failed: %s.print\n", modname, instname);
+      return r;
+    }
+  }
+
   return 0;
 }
            